@@ -0,0 +1,327 @@
+//  BatchPipeline.cpp
+//  Purpose: Implements the BatchPipeline defined in BatchPipeline.h
+
+#include "BatchPipeline.h"
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <thread>
+#include <chrono>
+
+static long long nowNs()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+BatchPipeline::BatchPipeline(BatchMode m, int workers)
+{
+  mode = m;
+  numWorkers = (workers < 1) ? 1 : workers;
+  Backjumping = false;
+  Lockstep = true;
+  lockstepSolved = 0;
+  toSolve = new BoundedQueue<PuzzleChunk*>(PIPELINE_QUEUE_SIZE);
+  toWrite = new BoundedQueue<PuzzleChunk*>(PIPELINE_QUEUE_SIZE);
+  activeWorkers = 0;
+  chunksWritten = 0;
+  aheadWaits = 0;
+  readerAsleep = false;
+  readStage.puzzles = readStage.busyNs = 0;
+  solveStage.puzzles = solveStage.busyNs = 0;
+  writeStage.puzzles = writeStage.busyNs = 0;
+  wallNs = 0;
+  failures = 0;
+  for (int i=0;i<6;i++)
+    resultCounts[i] = 0;
+}
+
+BatchPipeline::~BatchPipeline()
+{
+  delete toSolve;
+  delete toWrite;
+}
+
+void BatchPipeline::setBackjumping(bool enabled)
+{
+  Backjumping = enabled;
+}
+
+void BatchPipeline::setLockstep(bool enabled)
+{
+  Lockstep = enabled;
+}
+
+int BatchPipeline::run(int numFiles, char* files[], std::ostream& out)
+{
+  long long start = nowNs();
+  std::vector<std::thread> workers;
+
+  activeWorkers = numWorkers;
+  std::thread writer(&BatchPipeline::writeChunks, this, files, &out);
+  for (int i=0;i<numWorkers;i++)
+    workers.push_back(std::thread(&BatchPipeline::solveChunks, this));
+  std::thread reader(&BatchPipeline::readFiles, this, numFiles, files);
+
+  reader.join();
+  for (int i=0;i<numWorkers;i++)
+    workers[i].join();
+  writer.join();
+
+  wallNs = nowNs() - start;
+  return failures;
+}
+
+void BatchPipeline::readFiles(int numFiles, char** files)
+{
+  std::ifstream fin;
+  PuzzleChunk* chunk;
+  long long sequence = 0;
+  long long index;
+  long long busyStart;
+  bool readFailed;
+
+  for (int f=0;f<numFiles;f++)
+  {
+    fin.open(files[f]);
+    readFailed = fin.fail();
+    if (readFailed)
+    {
+      //errors go through the writer like everything else, so they're reported in order
+      chunk = new PuzzleChunk();
+      chunk->sequence = sequence++;
+      chunk->file = f;
+      chunk->firstIndex = 0;
+      chunk->readError = std::string("Error, could not open ") + files[f] + " for reading";
+      fin.clear();
+      failures++;
+      toSolve->push(chunk);
+      continue;
+    }
+
+    index = 0;
+    while (!readFailed)
+    {
+      //don't let the reader run too far ahead of the writer, or finished chunks waiting
+      //to be written in order could pile up without bound
+      if (sequence - chunksWritten.load() >= 2*PIPELINE_QUEUE_SIZE)
+      {
+	aheadWaits++;
+	for (int spins=0;sequence - chunksWritten.load() >= 2*PIPELINE_QUEUE_SIZE;spins++)
+	{
+	  if (spins < PIPELINE_SPIN_LIMIT)
+	  {
+	    std::this_thread::yield();
+	    continue;
+	  }
+	  //same handshake as BoundedQueue: the writer only takes the lock to wake the reader once it's asleep
+	  std::unique_lock<std::mutex> lock(aheadLock);
+	  readerAsleep = true;
+	  std::atomic_thread_fence(std::memory_order_seq_cst);
+	  if (sequence - chunksWritten.load() >= 2*PIPELINE_QUEUE_SIZE)
+	    writerCaughtUp.wait(lock);
+	  readerAsleep = false;
+	}
+      }
+
+      busyStart = nowNs();
+      chunk = new PuzzleChunk();
+      chunk->sequence = sequence;
+      chunk->file = f;
+      chunk->firstIndex = index;
+      chunk->puzzles.reserve(BATCH_CHUNK_SIZE);
+      while ((int)chunk->puzzles.size() < BATCH_CHUNK_SIZE && !(fin >> std::ws).eof())
+      {
+	chunk->puzzles.push_back(Puzzle());
+	if (!SudokuMatrix::readPuzzle(fin, chunk->puzzles.back().cells, true))
+	{
+	  chunk->readError = std::string("Stopped reading ") + files[f] + " at puzzle " + std::to_string(index);
+	  chunk->puzzles.pop_back();
+	  readFailed = true;
+	  failures++;
+	  break;
+	}
+	index++;
+      }
+      readStage.busyNs += nowNs() - busyStart;
+
+      if (chunk->puzzles.empty() && !readFailed)
+      {
+	delete chunk;
+	break;
+      }
+      readStage.puzzles += chunk->puzzles.size();
+      toSolve->push(chunk);
+      sequence++;
+    }
+    fin.close();
+    fin.clear();
+  }
+  toSolve->close();
+}
+
+void BatchPipeline::solveChunks()
+{
+  //every worker needs a matrix of its own, since solving modifies it
+  SudokuMatrix m;
+  DifficultyGrader grader;
+  LockstepSolver* lockstep = new LockstepSolver();
+  PuzzleChunk* chunk;
+  long long busyStart;
+  int numPuzzles, lanes;
+
+  m.initialize();
+  m.setBackjumping(Backjumping);
+  while (toSolve->pop(chunk))
+  {
+    busyStart = nowNs();
+    numPuzzles = chunk->puzzles.size();
+    if (mode == BATCH_GRADE)
+    {
+      chunk->grades.resize(numPuzzles);
+      for (int p=0;p<numPuzzles;p++)
+	chunk->grades[p] = grader.grade(&m, chunk->puzzles[p].cells);
+    }
+    else
+    {
+      chunk->solutions.resize(numPuzzles);
+      chunk->solved.resize(numPuzzles);
+      chunk->conflicting.assign(numPuzzles, 0);
+      for (int p=0;p<numPuzzles;p+=LOCKSTEP_LANES)
+      {
+	lanes = (numPuzzles-p < LOCKSTEP_LANES) ? numPuzzles-p : LOCKSTEP_LANES;
+	if (Lockstep)
+	  lockstepSolved += lockstep->solve(&chunk->puzzles[p], lanes, &chunk->solutions[p], &chunk->solved[p]);
+	//anything propagation couldn't finish needs a real search
+	for (int l=p;l<p+lanes;l++)
+	{
+	  if (!Lockstep || !chunk->solved[l])
+	  {
+	    chunk->solved[l] = m.solvePuzzle(chunk->puzzles[l].cells, chunk->solutions[l].cells);
+	    chunk->conflicting[l] = m.givensConflicted();
+	  }
+	}
+      }
+    }
+    solveStage.busyNs += nowNs() - busyStart;
+    solveStage.puzzles += numPuzzles;
+    toWrite->push(chunk);
+  }
+
+  delete lockstep;
+  if (--activeWorkers == 0)
+    toWrite->close();
+}
+
+void BatchPipeline::writeChunks(char** files, std::ostream* out)
+{
+  //workers finish chunks in any order, so hold on to the early ones until it's their turn
+  std::map<long long, PuzzleChunk*> waiting;
+  PuzzleChunk* chunk;
+  long long nextSequence = 0;
+  long long busyStart;
+
+  while (toWrite->pop(chunk))
+  {
+    waiting[chunk->sequence] = chunk;
+    while (!waiting.empty() && waiting.begin()->first == nextSequence)
+    {
+      busyStart = nowNs();
+      chunk = waiting.begin()->second;
+      waiting.erase(waiting.begin());
+      formatChunk(chunk, files, *out);
+      writeStage.puzzles += chunk->puzzles.size();
+      delete chunk;
+      nextSequence++;
+      chunksWritten++;
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (readerAsleep.load())
+      {
+	std::lock_guard<std::mutex> lock(aheadLock);
+	writerCaughtUp.notify_one();
+      }
+      writeStage.busyNs += nowNs() - busyStart;
+    }
+  }
+  out->flush();
+}
+
+void BatchPipeline::formatChunk(PuzzleChunk* chunk, char** files, std::ostream& out)
+{
+  //build the whole chunk's output first so it goes out in one write
+  std::ostringstream text, notes;
+  for (unsigned int p=0;p<chunk->puzzles.size();p++)
+  {
+    if (mode == BATCH_GRADE)
+    {
+      Grade& g = chunk->grades[p];
+      text << files[chunk->file] << " #" << chunk->firstIndex+p << ": " << DifficultyGrader::levelName(g.level)
+	<< " (" << DifficultyGrader::techniqueName(g.hardest) << "), nodes " << g.stats.nodes << ", backtracks "
+	<< g.stats.backtracks << ", branching " << g.stats.branchingSum << "\n";
+      resultCounts[g.level]++;
+    }
+    else
+    {
+      //solutions are written in the same format puzzles are read in, unsolved cells stay 0
+      for (int i=0;i<MATRIX_SIZE;i++)
+      {
+	for (int j=0;j<MATRIX_SIZE;j++)
+	  text << chunk->solutions[p].cells[i][j] << " ";
+	text << "\n";
+      }
+      text << "\n";
+      if (chunk->conflicting[p])
+	notes << files[chunk->file] << " #" << chunk->firstIndex+p << ": givens conflict\n";
+      else if (!chunk->solved[p])
+	notes << files[chunk->file] << " #" << chunk->firstIndex+p << ": no solution\n";
+      resultCounts[chunk->conflicting[p] ? 2 : (chunk->solved[p] ? 1 : 0)]++;
+    }
+  }
+  if (!chunk->readError.empty())
+    notes << chunk->readError << "\n";
+  out << text.str();
+  //flush the results first so notes land after them when both streams go to the same place
+  if (!notes.str().empty())
+  {
+    out.flush();
+    std::cerr << notes.str();
+  }
+}
+
+void BatchPipeline::printStats(std::ostream& out)
+{
+  const char* names[] = {"read", "solve", "write"};
+  StageCounters* stages[] = {&readStage, &solveStage, &writeStage};
+  double busyMs;
+
+  out << "Processed " << writeStage.puzzles << " puzzles in " << wallNs/1e6 << " ms ("
+    << (wallNs > 0 ? writeStage.puzzles*1e9/wallNs : 0) << " puzzles/s) with " << numWorkers << " workers" << std::endl;
+  for (int s=0;s<3;s++)
+  {
+    busyMs = stages[s]->busyNs/1e6;
+    out << "  " << names[s] << ": " << stages[s]->puzzles << " puzzles, busy " << busyMs << " ms";
+    if (busyMs > 0)
+      out << " (" << stages[s]->puzzles/busyMs*1000 << " puzzles/s per busy thread)";
+    out << std::endl;
+  }
+  out << "  waits on a full queue: reader " << toSolve->fullWaits() << ", workers " << toWrite->fullWaits()
+    << "; reader waits on the writer: " << aheadWaits << std::endl;
+  out << "  waits on an empty queue: workers " << toSolve->emptyWaits() << ", writer " << toWrite->emptyWaits()
+    << std::endl;
+
+  if (mode == BATCH_GRADE)
+  {
+    out << " ";
+    for (int level=1;level<=5;level++)
+      out << " " << DifficultyGrader::levelName(level) << " " << resultCounts[level] << ",";
+    out << " " << DifficultyGrader::levelName(0) << " " << resultCounts[0] << std::endl;
+  }
+  else
+  {
+    out << "  solved " << resultCounts[1] << ", not solvable " << resultCounts[0] << ", conflicting givens "
+      << resultCounts[2] << std::endl;
+    if (Lockstep)
+      out << "  lockstep engine solved " << lockstepSolved << ", handed " << writeStage.puzzles-lockstepSolved
+	<< " to Dancing Links" << std::endl;
+  }
+}
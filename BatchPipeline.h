@@ -0,0 +1,113 @@
+//BatchPipeline.h
+//  Purpose: See below
+
+// solves or grades files full of puzzles with three overlapping stages, so that reading and writing
+// happen while the puzzles in between are being worked on:
+//
+//   reader --> [toSolve queue] --> workers (one SudokuMatrix each) --> [toWrite queue] --> writer
+//
+// The reader parses BATCH_CHUNK_SIZE puzzles at a time into a chunk, any free worker solves (or grades) the
+// whole chunk, and the writer puts finished chunks back in their original order before formatting them.
+// The queues are bounded and lock-free, and the reader never gets more than 2*PIPELINE_QUEUE_SIZE chunks
+// ahead of the writer, so a slow stage holds back the stages before it instead of letting work pile up.
+// Every stage counts the puzzles it handled and the time it spent busy (not waiting on a queue)
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include "SudokuMatrix.h"
+#include "DifficultyGrader.h"
+#include "LockstepSolver.h"
+#include "BoundedQueue.h"
+#include "Definitions.h"
+
+enum BatchMode
+{
+  BATCH_SOLVE, //write out the solution of every puzzle
+  BATCH_GRADE //write out the grade of every puzzle
+};
+
+//a run of consecutive puzzles from one file, the unit of work passed between stages
+struct PuzzleChunk
+{
+  long long sequence; //position of the chunk in the whole run, so chunks can be written in order
+  int file; //index of the file the puzzles came from
+  long long firstIndex; //index of the first puzzle within its file
+  std::vector<Puzzle> puzzles;
+  std::vector<Puzzle> solutions; //BATCH_SOLVE only
+  std::vector<char> solved; //BATCH_SOLVE only, whether each puzzle was solved
+  std::vector<char> conflicting; //BATCH_SOLVE only, whether each puzzle's givens conflict with each other
+  std::vector<Grade> grades; //BATCH_GRADE only
+  std::string readError; //why the reader stopped after the chunk's puzzles, empty if it didn't
+};
+
+//throughput counters for one stage of the pipeline
+struct StageCounters
+{
+  std::atomic<long long> puzzles; //puzzles the stage has handled
+  std::atomic<long long> busyNs; //time spent working, summed over the stage's threads
+};
+
+class BatchPipeline
+{
+  public:
+    BatchPipeline(BatchMode m, int workers);
+    //workers is the number of solving threads, at least 1
+    ~BatchPipeline();
+
+    void setBackjumping(bool enabled);
+    //pre: none
+    //post: every worker's SudokuMatrix will search with conflict-directed backjumping
+
+    void setLockstep(bool enabled);
+    //pre: none
+    //post: if enabled, BATCH_SOLVE workers first propagate LOCKSTEP_LANES puzzles at a time with a LockstepSolver
+    //	and only hand the puzzles it can't finish to their SudokuMatrix. On by default
+
+    int run(int numFiles, char* files[], std::ostream& out);
+    //pre: none
+    //post: processes every puzzle in every file (a file may hold any number of puzzles one after the other)
+    //	and writes the results to out in the order the puzzles were read.
+    //	returns the number of files that could not be read completely
+
+    void printStats(std::ostream& out);
+    //pre: run has finished
+    //post: prints the throughput of every stage, how often the stages had to wait on a full queue,
+    //	and a summary of the results
+
+  private:
+    BatchMode mode;
+    int numWorkers;
+    bool Backjumping;
+    bool Lockstep;
+    std::atomic<long long> lockstepSolved; //puzzles the lockstep engine finished without Dancing Links
+    BoundedQueue<PuzzleChunk*>* toSolve; //chunks the reader has filled and the workers haven't taken
+    BoundedQueue<PuzzleChunk*>* toWrite; //chunks the workers have finished and the writer hasn't taken
+    std::atomic<int> activeWorkers; //the last worker to finish closes toWrite
+    std::atomic<long long> chunksWritten;
+    long long aheadWaits; //times the reader had to wait for the writer to catch up
+    std::mutex aheadLock; //held while the reader decides to sleep until the writer catches up
+    std::condition_variable writerCaughtUp;
+    std::atomic<bool> readerAsleep;
+    StageCounters readStage, solveStage, writeStage;
+    long long wallNs; //time the whole run took
+    int failures; //files that could not be read completely
+    long long resultCounts[6]; //grade levels, or unsolved/solved/conflicting puzzles for BATCH_SOLVE
+
+    void readFiles(int numFiles, char** files);
+    //reader stage, runs on its own thread
+
+    void solveChunks();
+    //worker stage, one thread per worker
+
+    void writeChunks(char** files, std::ostream* out);
+    //writer stage, runs on its own thread
+
+    void formatChunk(PuzzleChunk* chunk, char** files, std::ostream& out);
+    //writes the results of one chunk to out, and why each puzzle BATCH_SOLVE couldn't solve failed to stderr.
+    //only the writer prints, so these come out in the same order as the results
+};
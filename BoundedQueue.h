@@ -0,0 +1,250 @@
+//BoundedQueue.h
+//  Purpose: See below
+
+// a fixed capacity, lock-free queue that any number of threads can push to and pop from at once
+// (Dmitry Vyukov's bounded MPMC queue). Every slot carries a sequence number that says whether it is
+// ready to be written or read for the current lap around the buffer, so producers and consumers only
+// ever contend on a single compare-and-swap of their own position counter.
+//
+// push waits while the queue is full, which is how a fast stage is held back (backpressure) by a slow
+// stage after it, and pop waits while it is empty. Waiting threads yield PIPELINE_SPIN_LIMIT times and then
+// sleep on a condition variable, so a stalled stage doesn't keep a core busy. The other side only takes the
+// lock to wake them when someone is actually asleep. The number of waits on each side is counted so the
+// pipeline can report it
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+#include "Definitions.h"
+
+template<typename T>
+class BoundedQueue
+{
+  public:
+    BoundedQueue(unsigned int capacity);
+    //capacity is rounded up to a power of two
+    ~BoundedQueue();
+
+    bool tryPush(const T& item);
+    //adds item if there is room, returns false if the queue was full
+
+    bool tryPop(T& item);
+    //takes the oldest item if there is one, returns false if the queue was empty
+
+    void push(const T& item);
+    //adds item, waiting for room if the queue is full
+
+    bool pop(T& item);
+    //takes the oldest item, waiting for one if the queue is empty.
+    //returns false once the queue has been closed and everything in it taken
+
+    void close();
+    //signals that nothing more will be pushed
+
+    long long fullWaits();
+    //returns how many pushes had to wait for room
+
+    long long emptyWaits();
+    //returns how many pops had to wait for an item
+
+  private:
+    struct Slot
+    {
+      std::atomic<size_t> sequence;
+      T data;
+    };
+
+    Slot* buffer;
+    size_t mask;
+    std::atomic<size_t> enqueuePos;
+    std::atomic<size_t> dequeuePos;
+    std::atomic<bool> closed;
+    std::atomic<long long> waits;
+    std::atomic<long long> idleWaits;
+
+    std::mutex parkLock; //held while a waiting thread decides to sleep
+    std::condition_variable notFull, notEmpty;
+    std::atomic<int> pushSleepers, popSleepers;
+
+    void wake(std::condition_variable& cond, std::atomic<int>& sleepers);
+    //wakes the threads sleeping on cond, if there are any
+};
+
+template<typename T>
+BoundedQueue<T>::BoundedQueue(unsigned int capacity)
+{
+  size_t size = 2;
+  while (size < capacity)
+    size *= 2;
+  buffer = new Slot[size];
+  mask = size-1;
+  for (size_t i=0;i<size;i++)
+    buffer[i].sequence.store(i, std::memory_order_relaxed);
+  enqueuePos.store(0, std::memory_order_relaxed);
+  dequeuePos.store(0, std::memory_order_relaxed);
+  closed.store(false);
+  waits.store(0);
+  idleWaits.store(0);
+  pushSleepers.store(0);
+  popSleepers.store(0);
+}
+
+template<typename T>
+BoundedQueue<T>::~BoundedQueue()
+{
+  delete [] buffer;
+}
+
+template<typename T>
+bool BoundedQueue<T>::tryPush(const T& item)
+{
+  Slot* slot;
+  size_t seq;
+  intptr_t dif;
+  size_t pos = enqueuePos.load(std::memory_order_relaxed);
+  while (true)
+  {
+    slot = &buffer[pos & mask];
+    seq = slot->sequence.load(std::memory_order_acquire);
+    dif = (intptr_t)seq - (intptr_t)pos;
+    if (dif == 0)
+    {
+      //slot is free for this lap, claim it
+      if (enqueuePos.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed))
+	break;
+    }
+    else if (dif < 0)
+      return false; //slot still holds an item from the previous lap, so the queue is full
+    else
+      pos = enqueuePos.load(std::memory_order_relaxed); //another producer got here first
+  }
+  slot->data = item;
+  slot->sequence.store(pos+1, std::memory_order_release);
+  return true;
+}
+
+template<typename T>
+bool BoundedQueue<T>::tryPop(T& item)
+{
+  Slot* slot;
+  size_t seq;
+  intptr_t dif;
+  size_t pos = dequeuePos.load(std::memory_order_relaxed);
+  while (true)
+  {
+    slot = &buffer[pos & mask];
+    seq = slot->sequence.load(std::memory_order_acquire);
+    dif = (intptr_t)seq - (intptr_t)(pos+1);
+    if (dif == 0)
+    {
+      if (dequeuePos.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed))
+	break;
+    }
+    else if (dif < 0)
+      return false; //nothing has been written to this slot yet, so the queue is empty
+    else
+      pos = dequeuePos.load(std::memory_order_relaxed);
+  }
+  item = slot->data;
+  //free the slot for the producer one lap ahead
+  slot->sequence.store(pos+mask+1, std::memory_order_release);
+  return true;
+}
+
+template<typename T>
+void BoundedQueue<T>::wake(std::condition_variable& cond, std::atomic<int>& sleepers)
+{
+  //pairs with the fence in push and pop: either the sleeper sees what this thread just did, or this
+  //thread sees the sleeper and takes the lock, which it can only get once the sleeper is waiting
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (sleepers.load(std::memory_order_relaxed) > 0)
+  {
+    std::lock_guard<std::mutex> lock(parkLock);
+    cond.notify_all();
+  }
+}
+
+template<typename T>
+void BoundedQueue<T>::push(const T& item)
+{
+  bool pushed = tryPush(item);
+  if (!pushed)
+    waits++;
+  for (int spins=0;!pushed;spins++)
+  {
+    if (spins < PIPELINE_SPIN_LIMIT)
+    {
+      std::this_thread::yield();
+      pushed = tryPush(item);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(parkLock);
+    pushSleepers++;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    pushed = tryPush(item);
+    if (!pushed)
+      notFull.wait(lock);
+    pushSleepers--;
+  }
+  wake(notEmpty, popSleepers);
+}
+
+template<typename T>
+bool BoundedQueue<T>::pop(T& item)
+{
+  bool popped = tryPop(item);
+  bool done = false;
+  if (!popped)
+    idleWaits++;
+  for (int spins=0;!popped && !done;spins++)
+  {
+    if (closed.load(std::memory_order_acquire))
+    {
+      popped = tryPop(item); //anything pushed before close is visible now
+      done = true;
+    }
+    else if (spins < PIPELINE_SPIN_LIMIT)
+    {
+      std::this_thread::yield();
+      popped = tryPop(item);
+    }
+    else
+    {
+      std::unique_lock<std::mutex> lock(parkLock);
+      popSleepers++;
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      popped = tryPop(item);
+      //close takes the lock too, so checking closed here can't miss its wakeup
+      if (!popped && !closed.load(std::memory_order_acquire))
+	notEmpty.wait(lock);
+      popSleepers--;
+    }
+  }
+  if (popped)
+    wake(notFull, pushSleepers);
+  return popped;
+}
+
+template<typename T>
+void BoundedQueue<T>::close()
+{
+  closed.store(true, std::memory_order_release);
+  std::lock_guard<std::mutex> lock(parkLock);
+  notEmpty.notify_all();
+}
+
+template<typename T>
+long long BoundedQueue<T>::fullWaits()
+{
+  return waits.load();
+}
+
+template<typename T>
+long long BoundedQueue<T>::emptyWaits()
+{
+  return idleWaits.load();
+}
@@ -4,70 +4,109 @@
 //  Purpose: includes all the #defines needed for this project
 
 //assume 9x9 sudoku for building initial matrix
-//if we wish to expand, then only these defines should need to be changed appropriately
+//other board sizes are selected at compile time by defining SUDOKU_SIZE (see the Makefile), e.g.
+//  make clean && make SUDOKU_SIZE=25
+//if we wish to expand further, then only these defines should need to be changed appropriately
 
 #pragma once
 
-//these are offsets into the matrix that specify the sections of columns pertaining to 
-//row,column,cell,and box constraints respectively
-
-#define ROW_OFFSET 0 
-#define COL_OFFSET 81
-#define CELL_OFFSET 162
-#define BOX_OFFSET 243
+#ifndef SUDOKU_SIZE
+#define SUDOKU_SIZE 9
+#endif
 
 //these ultimately define the proportions of our matrix
-#define MATRIX_SIZE 9
-#define MAX_COLS 324
-#define MAX_ROWS 729
 
+#if SUDOKU_SIZE == 9
+#define MATRIX_SIZE 9
 #define COL_BOX_DIVISOR 3 //number of boxes in a column
 #define ROW_BOX_DIVISOR 3 //number of boxes in a row
 
+#elif SUDOKU_SIZE == 4
+#define MATRIX_SIZE 4
+#define ROW_BOX_DIVISOR 2
+#define COL_BOX_DIVISOR 2
 
+#elif SUDOKU_SIZE == 6
+#define MATRIX_SIZE 6
+#define ROW_BOX_DIVISOR 2
+#define COL_BOX_DIVISOR 3
 
-// If we want to expand from 9x9 Sudoku to 10 x 10 then theoretically :)
-// the following defines can replace the above ones though you may need to increase your stack size
-
-/*#define ROW_OFFSET 0 
-#define COL_OFFSET 100
-#define CELL_OFFSET 200
-#define BOX_OFFSET 300
-
+#elif SUDOKU_SIZE == 10
 #define MATRIX_SIZE 10
-#define MAX_COLS 400
-#define MAX_ROWS 1000
 #define ROW_BOX_DIVISOR 2
-#define COL_BOX_DIVISOR 5*/
-
-//likewise for a 12x12 matrix
-
-/*
-#define ROW_OFFSET 0 
-#define COL_OFFSET 144
-#define CELL_OFFSET 288
-#define BOX_OFFSET 432
+#define COL_BOX_DIVISOR 5
 
+#elif SUDOKU_SIZE == 12
 #define MATRIX_SIZE 12
-#define MAX_COLS 576
-#define MAX_ROWS 1728
-
 #define ROW_BOX_DIVISOR 4
 #define COL_BOX_DIVISOR 3
-*/
-
-//...and a 16x16 matrix
-
-/*
-#define ROW_OFFSET 0 
-#define COL_OFFSET 256
-#define CELL_OFFSET 512
-#define BOX_OFFSET 768
 
+#elif SUDOKU_SIZE == 16
 #define MATRIX_SIZE 16
-#define MAX_COLS 1024
-#define MAX_ROWS 4096
-
 #define ROW_BOX_DIVISOR 4
 #define COL_BOX_DIVISOR 4
-*/
+
+#elif SUDOKU_SIZE == 25
+#define MATRIX_SIZE 25
+#define ROW_BOX_DIVISOR 5
+#define COL_BOX_DIVISOR 5
+
+#elif SUDOKU_SIZE == 36
+#define MATRIX_SIZE 36
+#define ROW_BOX_DIVISOR 6
+#define COL_BOX_DIVISOR 6
+
+#else
+#error "Unsupported SUDOKU_SIZE, expected one of 4, 6, 9, 10, 12, 16, 25, or 36"
+#endif
+
+//these are offsets into the matrix that specify the sections of columns pertaining to 
+//row,column,cell,and box constraints respectively
+//(for 9x9 these are 0, 81, 162, and 243)
+
+#define ROW_OFFSET 0 
+#define COL_OFFSET (MATRIX_SIZE*MATRIX_SIZE)
+#define CELL_OFFSET (2*MATRIX_SIZE*MATRIX_SIZE)
+#define BOX_OFFSET (3*MATRIX_SIZE*MATRIX_SIZE)
+
+#define MAX_COLS (4*MATRIX_SIZE*MATRIX_SIZE) //324 for 9x9
+#define MAX_ROWS (MATRIX_SIZE*MATRIX_SIZE*MATRIX_SIZE) //729 for 9x9
+
+//every row of the matrix satisfies exactly one row, column, cell, and box constraint, so each row
+//has exactly ROW_WIDTH nodes. The rows are stored and walked with this fixed width, but the constraint table in
+//SudokuMatrix::initialize, MAX_COLS, and colNodes are still written for the four standard constraints, so
+//it can't be changed on its own
+#define ROW_WIDTH 4
+static_assert(ROW_WIDTH == 4, "SudokuMatrix::initialize only builds the four standard constraints");
+
+//conflict-directed backjumping (see SudokuMatrix::setBackjumping) remembers up to NOGOOD_CACHE_SIZE
+//learned nogoods, each a set of at most NOGOOD_MAX_SIZE decisions that can't all be part of a solution
+#define NOGOOD_CACHE_SIZE 4096
+#define NOGOOD_MAX_SIZE 16
+
+//when counting solutions with several threads, the top of the search tree is split into at least
+//this many subtrees per thread so that uneven subtrees still keep every thread busy
+#define COUNT_TASKS_PER_THREAD 32
+
+//batch modes read and process puzzles this many at a time
+#define BATCH_CHUNK_SIZE 256
+
+//number of chunks each queue of the batch pipeline can hold, and how far the reader can get ahead of the writer
+#define PIPELINE_QUEUE_SIZE 64
+
+//a pipeline thread that has to wait yields this many times before going to sleep until it is woken
+#define PIPELINE_SPIN_LIMIT 64
+
+//the batch solver's lockstep engine (see LockstepSolver.h) propagates this many puzzles at once
+#define LOCKSTEP_LANES 16
+
+//checkpoints (see SudokuMatrix::setCheckpoint) are saved every CHECKPOINT_SECONDS unless told otherwise.
+//the search only looks at the clock every CHECKPOINT_CHECK_INTERVAL iterations
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_SECONDS 60
+#define CHECKPOINT_CHECK_INTERVAL (1<<16)
+
+//search tracing (see SearchTrace.h) is compiled in only when SUDOKU_TRACE is defined, and keeps the
+//most recent TRACE_BUFFER_SIZE decisions
+//#define SUDOKU_TRACE
+#define TRACE_BUFFER_SIZE (1<<18)
@@ -0,0 +1,459 @@
+//  DifficultyGrader.cpp
+//  Purpose: Implements the DifficultyGrader defined in DifficultyGrader.h
+
+#include "DifficultyGrader.h"
+
+
+DifficultyGrader::DifficultyGrader()
+{
+  buildUnits(unitCells, cellUnits);
+  numPlaced = 0;
+  Invalid = false;
+}
+
+void DifficultyGrader::buildUnits(int unitCells[NUM_UNITS][MATRIX_SIZE], int cellUnits[][3])
+{
+  int box;
+  int boxCount[MATRIX_SIZE];
+  for (int b=0;b<MATRIX_SIZE;b++)
+    boxCount[b] = 0;
+
+  for (int i=0;i<MATRIX_SIZE;i++)
+  {
+    for (int j=0;j<MATRIX_SIZE;j++)
+    {
+      box = i/ROW_BOX_DIVISOR + j/COL_BOX_DIVISOR * COL_BOX_DIVISOR;
+      unitCells[i][j] = i*MATRIX_SIZE+j;
+      unitCells[MATRIX_SIZE+j][i] = i*MATRIX_SIZE+j;
+      unitCells[2*MATRIX_SIZE+box][boxCount[box]++] = i*MATRIX_SIZE+j;
+      if (cellUnits != NULL)
+      {
+	cellUnits[i*MATRIX_SIZE+j][0] = i;
+	cellUnits[i*MATRIX_SIZE+j][1] = MATRIX_SIZE+j;
+	cellUnits[i*MATRIX_SIZE+j][2] = 2*MATRIX_SIZE+box;
+      }
+    }
+  }
+}
+
+Technique DifficultyGrader::rate(int puzzle[MATRIX_SIZE][MATRIX_SIZE])
+{
+  Technique hardest = TECHNIQUE_NONE;
+  Technique next;
+
+  numPlaced = 0;
+  Invalid = false;
+  for (int c=0;c<MATRIX_SIZE*MATRIX_SIZE;c++)
+  {
+    candidates[c] = ALL_CANDIDATES;
+    placed[c] = false;
+  }
+  for (int i=0;i<MATRIX_SIZE && !Invalid;i++)
+  {
+    for (int j=0;j<MATRIX_SIZE && !Invalid;j++)
+    {
+      if (puzzle[i][j] != 0)
+	place(i*MATRIX_SIZE+j, puzzle[i][j]-1);
+    }
+  }
+
+  //always go back to the easiest technique after making progress, so harder ones are only used when needed
+  while (!Invalid && numPlaced < MATRIX_SIZE*MATRIX_SIZE)
+  {
+    if (hiddenSingles())
+      next = TECHNIQUE_HIDDEN_SINGLE;
+    else if (nakedSingles())
+      next = TECHNIQUE_NAKED_SINGLE;
+    else if (lockedCandidates())
+      next = TECHNIQUE_LOCKED_CANDIDATES;
+    else if (nakedPairs())
+      next = TECHNIQUE_NAKED_PAIR;
+    else if (hiddenPairs())
+      next = TECHNIQUE_HIDDEN_PAIR;
+    else if (fish(2))
+      next = TECHNIQUE_X_WING;
+    else if (fish(3))
+      next = TECHNIQUE_SWORDFISH;
+    else
+      return TECHNIQUE_SEARCH;
+
+    if (next > hardest)
+      hardest = next;
+  }
+
+  if (Invalid)
+    return TECHNIQUE_INVALID;
+  return hardest;
+}
+
+Grade DifficultyGrader::grade(SudokuMatrix* m, int puzzle[MATRIX_SIZE][MATRIX_SIZE])
+{
+  Grade result;
+  int solution[MATRIX_SIZE][MATRIX_SIZE];
+  long long untried;
+
+  result.hardest = rate(puzzle);
+  result.solved = m->solvePuzzle(puzzle, solution);
+  result.stats = m->getStats();
+
+  if (!result.solved || result.hardest == TECHNIQUE_INVALID)
+    result.level = 0;
+  else if (result.hardest <= TECHNIQUE_NAKED_SINGLE)
+    result.level = 1;
+  else if (result.hardest <= TECHNIQUE_HIDDEN_PAIR)
+    result.level = 2;
+  else if (result.hardest <= TECHNIQUE_SWORDFISH)
+    result.level = 3;
+  else
+  {
+    //a solved search tries each row of the solution once, and backs out of every other row it tries, so nodes is
+    //always the number of empty cells plus backtracks and adds nothing on its own. Taken together with the
+    //branching sum (the rows available at every column branched on) it gives the rows that were open at a branch
+    //point but never tried: how wide the guesses were, even when the search happened to guess right
+    untried = result.stats.branchingSum - result.stats.nodes;
+    if (result.stats.backtracks < EXTREME_BACKTRACKS && untried < EXTREME_UNTRIED_ROWS)
+      result.level = 4;
+    else
+      result.level = 5;
+  }
+
+  return result;
+}
+
+const char* DifficultyGrader::techniqueName(Technique t)
+{
+  switch (t)
+  {
+    case TECHNIQUE_NONE: return "None";
+    case TECHNIQUE_HIDDEN_SINGLE: return "Hidden single";
+    case TECHNIQUE_NAKED_SINGLE: return "Naked single";
+    case TECHNIQUE_LOCKED_CANDIDATES: return "Locked candidates";
+    case TECHNIQUE_NAKED_PAIR: return "Naked pair";
+    case TECHNIQUE_HIDDEN_PAIR: return "Hidden pair";
+    case TECHNIQUE_X_WING: return "X-Wing";
+    case TECHNIQUE_SWORDFISH: return "Swordfish";
+    case TECHNIQUE_SEARCH: return "Search";
+    default: return "Invalid";
+  }
+}
+
+const char* DifficultyGrader::levelName(int level)
+{
+  const char* names[] = {"Unsolvable", "Easy", "Medium", "Hard", "Expert", "Extreme"};
+  if (level < 0 || level > 5)
+    return "Unknown";
+  return names[level];
+}
+
+void DifficultyGrader::place(int cell, int value)
+{
+  CandidateMask bit = (CandidateMask)1 << value;
+  int peer;
+  if (placed[cell] || !(candidates[cell] & bit))
+  {
+    Invalid = true; //value was already ruled out here
+    return;
+  }
+
+  candidates[cell] = bit;
+  placed[cell] = true;
+  numPlaced++;
+  for (int u=0;u<3;u++)
+  {
+    for (int k=0;k<MATRIX_SIZE;k++)
+    {
+      peer = unitCells[cellUnits[cell][u]][k];
+      if (!placed[peer] && (candidates[peer] & bit))
+	eliminate(peer, bit);
+    }
+  }
+}
+
+void DifficultyGrader::eliminate(int cell, CandidateMask toRemove)
+{
+  candidates[cell] &= ~toRemove;
+  if (candidates[cell] == 0)
+    Invalid = true;
+}
+
+bool DifficultyGrader::hiddenSingles()
+{
+  CandidateMask once, twice, done, hidden, bit;
+  int cell;
+  bool progress = false;
+
+  for (int u=0;u<NUM_UNITS && !Invalid;u++)
+  {
+    once = twice = done = 0;
+    for (int k=0;k<MATRIX_SIZE;k++)
+    {
+      cell = unitCells[u][k];
+      if (placed[cell])
+	done |= candidates[cell];
+      else
+      {
+	twice |= once & candidates[cell];
+	once |= candidates[cell];
+      }
+    }
+    if ((once | done) != ALL_CANDIDATES)
+    {
+      Invalid = true; //some value can't go anywhere in this unit
+      return true;
+    }
+
+    hidden = once & ~twice & ~done;
+    for (int k=0;k<MATRIX_SIZE && hidden != 0 && !Invalid;k++)
+    {
+      cell = unitCells[u][k];
+      bit = candidates[cell] & hidden;
+      if (!placed[cell] && bit != 0)
+      {
+	hidden &= ~bit;
+	if (bit & (bit-1))
+	{
+	  Invalid = true; //two values can only go in this one cell
+	  return true;
+	}
+	place(cell, __builtin_ctzll(bit));
+	progress = true;
+      }
+    }
+  }
+  return progress;
+}
+
+bool DifficultyGrader::nakedSingles()
+{
+  bool progress = false;
+  for (int c=0;c<MATRIX_SIZE*MATRIX_SIZE && !Invalid;c++)
+  {
+    if (!placed[c] && !(candidates[c] & (candidates[c]-1)))
+    {
+      place(c, __builtin_ctzll(candidates[c]));
+      progress = true;
+    }
+  }
+  return progress;
+}
+
+bool DifficultyGrader::lockedCandidates()
+{
+  CandidateMask bit;
+  int cell, count, other;
+  int shared[3]; //unit of each type that every cell holding the value has in common, -1 if none
+  bool progress = false;
+
+  for (int u=0;u<NUM_UNITS && !Invalid;u++)
+  {
+    for (int v=0;v<MATRIX_SIZE;v++)
+    {
+      bit = (CandidateMask)1 << v;
+      count = 0;
+      for (int t=0;t<3;t++)
+	shared[t] = -1;
+      for (int k=0;k<MATRIX_SIZE;k++)
+      {
+	cell = unitCells[u][k];
+	if (placed[cell] || !(candidates[cell] & bit))
+	  continue;
+	for (int t=0;t<3;t++)
+	{
+	  if (count == 0)
+	    shared[t] = cellUnits[cell][t];
+	  else if (shared[t] != cellUnits[cell][t])
+	    shared[t] = -1;
+	}
+	count++;
+      }
+      if (count < 2)
+	continue;
+
+      //the value has to go in the part of u that overlaps the shared unit, so it can't go in the rest of that unit
+      for (int t=0;t<3;t++)
+      {
+	if (shared[t] < 0 || shared[t] == u)
+	  continue;
+	for (int k=0;k<MATRIX_SIZE;k++)
+	{
+	  other = unitCells[shared[t]][k];
+	  if (!placed[other] && (candidates[other] & bit) && cellUnits[other][u/MATRIX_SIZE] != u)
+	  {
+	    eliminate(other, bit);
+	    progress = true;
+	  }
+	}
+      }
+    }
+  }
+  return progress;
+}
+
+bool DifficultyGrader::nakedPairs()
+{
+  int a, b, other;
+  bool progress = false;
+
+  for (int u=0;u<NUM_UNITS && !Invalid;u++)
+  {
+    for (int i=0;i<MATRIX_SIZE;i++)
+    {
+      a = unitCells[u][i];
+      if (placed[a] || __builtin_popcountll(candidates[a]) != 2)
+	continue;
+      for (int j=i+1;j<MATRIX_SIZE;j++)
+      {
+	b = unitCells[u][j];
+	if (placed[b] || candidates[b] != candidates[a])
+	  continue;
+
+	//a and b take both values between them, so nothing else in the unit can
+	for (int k=0;k<MATRIX_SIZE;k++)
+	{
+	  other = unitCells[u][k];
+	  if (other != a && other != b && !placed[other] && (candidates[other] & candidates[a]))
+	  {
+	    eliminate(other, candidates[a]);
+	    progress = true;
+	  }
+	}
+      }
+    }
+  }
+  return progress;
+}
+
+bool DifficultyGrader::hiddenPairs()
+{
+  unsigned long long where[MATRIX_SIZE]; //for each value, the positions in the unit it can go
+  CandidateMask pair;
+  int cell;
+  bool progress = false;
+
+  for (int u=0;u<NUM_UNITS && !Invalid;u++)
+  {
+    for (int v=0;v<MATRIX_SIZE;v++)
+      where[v] = 0;
+    for (int k=0;k<MATRIX_SIZE;k++)
+    {
+      cell = unitCells[u][k];
+      if (placed[cell])
+	continue;
+      for (int v=0;v<MATRIX_SIZE;v++)
+      {
+	if (candidates[cell] & ((CandidateMask)1 << v))
+	  where[v] |= 1ULL << k;
+      }
+    }
+
+    for (int v=0;v<MATRIX_SIZE;v++)
+    {
+      if (__builtin_popcountll(where[v]) != 2)
+	continue;
+      for (int w=v+1;w<MATRIX_SIZE;w++)
+      {
+	if (where[w] != where[v])
+	  continue;
+
+	//v and w have to take these two cells between them, so the cells can't hold anything else
+	pair = ((CandidateMask)1 << v) | ((CandidateMask)1 << w);
+	for (int k=0;k<MATRIX_SIZE;k++)
+	{
+	  cell = unitCells[u][k];
+	  if ((where[v] & (1ULL << k)) && (candidates[cell] & ~pair))
+	  {
+	    eliminate(cell, candidates[cell] & ~pair);
+	    progress = true;
+	  }
+	}
+      }
+    }
+  }
+  return progress;
+}
+
+bool DifficultyGrader::fish(int size)
+{
+  unsigned long long where[MATRIX_SIZE]; //for each base line, the cover lines the value can go in
+  int lines[MATRIX_SIZE]; //base lines with between 2 and size places left for the value
+  int numLines, cell;
+  int chosen[3];
+  CandidateMask bit;
+
+  for (int v=0;v<MATRIX_SIZE && !Invalid;v++)
+  {
+    bit = (CandidateMask)1 << v;
+    //first with rows as the base lines and columns as the cover lines, then the other way around
+    for (int byRow=1;byRow>=0;byRow--)
+    {
+      numLines = 0;
+      for (int base=0;base<MATRIX_SIZE;base++)
+      {
+	where[base] = 0;
+	for (int c=0;c<MATRIX_SIZE;c++)
+	{
+	  cell = byRow ? base*MATRIX_SIZE+c : c*MATRIX_SIZE+base;
+	  if (!placed[cell] && (candidates[cell] & bit))
+	    where[base] |= 1ULL << c;
+	}
+	if (__builtin_popcountll(where[base]) >= 2 && __builtin_popcountll(where[base]) <= size)
+	  lines[numLines++] = base;
+      }
+
+      //try every combination of size base lines
+      for (int a=0;a<numLines;a++)
+      {
+	chosen[0] = lines[a];
+	for (int b=a+1;b<numLines;b++)
+	{
+	  chosen[1] = lines[b];
+	  if (size == 2)
+	  {
+	    if (eliminateFish(bit, byRow, where, chosen, size))
+	      return true;
+	    continue;
+	  }
+	  for (int c=b+1;c<numLines;c++)
+	  {
+	    chosen[2] = lines[c];
+	    if (eliminateFish(bit, byRow, where, chosen, size))
+	      return true;
+	  }
+	}
+      }
+    }
+  }
+  return false;
+}
+
+bool DifficultyGrader::eliminateFish(CandidateMask bit, bool byRow, unsigned long long* where, int* chosen, int size)
+{
+  unsigned long long cover = 0;
+  bool isChosen, progress = false;
+  int cell;
+
+  for (int k=0;k<size;k++)
+    cover |= where[chosen[k]];
+  if (__builtin_popcountll(cover) != size)
+    return false;
+
+  //the value has to go somewhere in cover on each of the chosen lines, so it can't go in cover anywhere else
+  for (int base=0;base<MATRIX_SIZE;base++)
+  {
+    isChosen = false;
+    for (int k=0;k<size;k++)
+      isChosen = isChosen || (chosen[k] == base);
+    if (isChosen || !(where[base] & cover))
+      continue;
+    for (int c=0;c<MATRIX_SIZE;c++)
+    {
+      cell = byRow ? base*MATRIX_SIZE+c : c*MATRIX_SIZE+base;
+      if ((cover & (1ULL << c)) && !placed[cell] && (candidates[cell] & bit))
+      {
+	eliminate(cell, bit);
+	progress = true;
+      }
+    }
+  }
+  return progress;
+}
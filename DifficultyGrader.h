@@ -0,0 +1,118 @@
+//DifficultyGrader.h
+//  Purpose: See below
+
+// grades how hard a Sudoku puzzle is, both by how much work the DLX search in SudokuMatrix had to do, and by
+// which human solving techniques are needed to solve it without guessing
+
+/*
+   The technique rater keeps a bitmask of candidate values for every cell (bit v set if value v+1 is still
+   possible) and repeatedly applies the easiest technique that makes progress:
+
+   Hidden single	a value can only go in one cell of a row, column, or box
+   Naked single		a cell only has one candidate left
+   Locked candidates	a value's candidates in one unit all lie in another unit (a box and a row or column),
+			so the value can be removed from the rest of that other unit
+   Naked pair		two cells of a unit have the same two candidates, so no other cell of the unit can have them
+   Hidden pair		two values can only go in the same two cells of a unit, so those cells can't have anything else
+   X-Wing, Swordfish	a value's candidates in 2 (or 3) rows all lie in 2 (or 3) columns, so the value can be
+			removed from the rest of those columns (and likewise with rows and columns swapped)
+
+   The puzzle is rated by the hardest technique it needed. If none of them make progress, it needs search.
+ */
+
+#pragma once
+
+#include "SudokuMatrix.h"
+#include "Definitions.h"
+
+//one bit per value, wide enough for the board size
+#if MATRIX_SIZE <= 16
+typedef unsigned short CandidateMask;
+#elif MATRIX_SIZE <= 32
+typedef unsigned int CandidateMask;
+#else
+typedef unsigned long long CandidateMask;
+#endif
+
+#define ALL_CANDIDATES ((CandidateMask)((1ULL << MATRIX_SIZE) - 1))
+#define NUM_UNITS (3*MATRIX_SIZE) //every row, column, and box
+
+//puzzles that need search are graded extreme once the search backtracks at least this many times, or leaves
+//at least this many rows untried at its branch points (see DifficultyGrader::grade)
+#define EXTREME_BACKTRACKS (MATRIX_SIZE*MATRIX_SIZE)
+#define EXTREME_UNTRIED_ROWS MATRIX_SIZE
+
+//techniques in the order they are tried, easiest first
+enum Technique
+{
+  TECHNIQUE_NONE, //puzzle was already full
+  TECHNIQUE_HIDDEN_SINGLE,
+  TECHNIQUE_NAKED_SINGLE,
+  TECHNIQUE_LOCKED_CANDIDATES,
+  TECHNIQUE_NAKED_PAIR,
+  TECHNIQUE_HIDDEN_PAIR,
+  TECHNIQUE_X_WING,
+  TECHNIQUE_SWORDFISH,
+  TECHNIQUE_SEARCH, //none of the techniques could finish the puzzle
+  TECHNIQUE_INVALID //the givens contradict each other
+};
+
+struct Grade
+{
+  Technique hardest; //hardest technique needed to solve the puzzle
+  SearchStats stats; //work the DLX search did to solve it
+  bool solved; //whether the search found a solution
+  int level; //overall difficulty, 1 (easy) through 5 (extreme), 0 if the puzzle has no solution
+};
+
+class DifficultyGrader
+{
+  public:
+    DifficultyGrader();
+
+    Technique rate(int puzzle[MATRIX_SIZE][MATRIX_SIZE]);
+    //pre: none
+    //post: returns the hardest technique needed to solve puzzle, TECHNIQUE_SEARCH if the techniques
+    //	get stuck, or TECHNIQUE_INVALID if they run into a contradiction
+
+    Grade grade(SudokuMatrix* m, int puzzle[MATRIX_SIZE][MATRIX_SIZE]);
+    //pre: m has been initialized and has no puzzle loaded
+    //post: rates puzzle by technique and solves it with m to measure the search.
+    //	Levels are 1 for singles, 2 for locked candidates and pairs, 3 for fish, 4 for search, and 5 for search that
+    //	backtracked at least EXTREME_BACKTRACKS times or left at least EXTREME_UNTRIED_ROWS rows untried
+
+    static const char* techniqueName(Technique t);
+    static const char* levelName(int level);
+
+    static void buildUnits(int unitCells[NUM_UNITS][MATRIX_SIZE], int cellUnits[][3]);
+    //pre: none
+    //post: fills unitCells with the cells of every row, then every column, then every box (boxes labelled the
+    //	same way as SudokuMatrix), and cellUnits with the row, column, and box unit of every cell unless it's NULL
+
+  private:
+    CandidateMask candidates[MATRIX_SIZE*MATRIX_SIZE]; //candidate values of every cell, row-dominant order
+    bool placed[MATRIX_SIZE*MATRIX_SIZE]; //whether the cell's value has been placed and removed from its peers
+    int unitCells[NUM_UNITS][MATRIX_SIZE]; //cells of every row, then every column, then every box
+    int cellUnits[MATRIX_SIZE*MATRIX_SIZE][3]; //row, column, and box unit of every cell
+    int numPlaced;
+    bool Invalid; //set once a contradiction is found
+
+    void place(int cell, int value);
+    //sets cell to value and removes value from the candidates of every other cell sharing a unit with it
+
+    void eliminate(int cell, CandidateMask toRemove);
+    //removes candidates from an unplaced cell, flagging a contradiction if none are left
+
+    bool hiddenSingles();
+    bool nakedSingles();
+    bool lockedCandidates();
+    bool nakedPairs();
+    bool hiddenPairs();
+    bool fish(int size);
+    //each applies its technique everywhere it can, returning whether any progress was made
+    //(fish stops after the first fish that removes anything)
+
+    bool eliminateFish(CandidateMask bit, bool byRow, unsigned long long* where, int* chosen, int size);
+    //if the base lines in chosen only have room for bit in size cover lines between them, removes bit from
+    //those cover lines everywhere else. where holds the cover lines open to bit on each base line
+};
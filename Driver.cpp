@@ -3,25 +3,160 @@
  * Author: Andy Giese
  * Date: June 2011
  * Purpose: creates a SudokuMatrix object and gives it puzzles to solve
+ *
+ * Usage: SudokuSolver [options]                 prompts for puzzle files to solve
+ *        SudokuSolver [options] file1 file2 ... solves each file in turn and reports how long each one took
+ *        SudokuSolver [options] -r checkpoint   carries on with a search saved by -k
+ *
+ * Options: -b       search with conflict-directed backjumping
+ *          -c       count every solution of each file instead of solving it
+ *          -s       batch solve every puzzle in each file. A file may hold any number of
+ *                   puzzles one after the other
+ *          -d       with -s, solve every puzzle with Dancing Links instead of trying the lockstep
+ *                   engine first
+ *          -g       batch grade the difficulty of every puzzle in each file
+ *          -o file  write batch results to file instead of stdout
+ *          -T name  after solving each file, write its search trace to name<i>.json (Chrome trace) and
+ *                   name<i>.folded (folded stacks for flame graphs), where i is the file's position.
+ *                   Only available when built with make TRACE=1
+ *          -t N     number of threads to count or batch with (defaults to the number of cores)
+ *          -k file  save the state of each solve or count to file every CHECKPOINT_SECONDS, so it can be
+ *                   resumed with -r if the run is killed. Counting is done with one thread. Solves with -b
+ *                   can't be saved
+ *          -i N     save checkpoints every N seconds instead
+ *          -r file  resume the search saved in a checkpoint file, still saving checkpoints to it (or to the
+ *                   file given with -k). Takes no puzzle files
  */
 #include "SudokuMatrix.h"
+#include "BatchPipeline.h"
 #include <iostream>
+#include <fstream>
 #include <stack>
 #include <string>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
 using namespace std;
 #include "Definitions.h"
 
 
 
 bool initialize(SudokuMatrix* &m);
-int main()
+
+void printSolution(std::stack<Node>* solution);
+//pre: solution is the stack returned by SudokuMatrix::solve, or NULL
+//post: prints the board to stdout, cells that were not filled in are printed as 0s
+
+int solveFiles(SudokuMatrix* m, int numFiles, char* files[], const char* traceName);
+//pre: m has been initialized
+//post: solves every puzzle file without prompting and prints its solution and solve time,
+//	and writes the search trace of each if traceName isn't NULL.
+//	returns the number of puzzles that could not be solved
+
+int countFiles(SudokuMatrix* m, int numFiles, char* files[], int numThreads);
+//pre: m has been initialized
+//post: prints how many solutions each puzzle file has and how long counting took,
+//	returns the number of files that could not be read
+
+int batchFiles(BatchMode mode, int numFiles, char* files[], int numThreads, bool backjumping, bool lockstep,
+    const char* outFile);
+//pre: none
+//post: solves or grades every puzzle in every file through a BatchPipeline and writes the results to
+//	outFile (stdout if NULL), then prints the pipeline's throughput to stderr.
+//	returns the number of files that could not be read completely
+
+#ifdef SUDOKU_TRACE
+void writeTrace(SearchTrace* trace, const char* traceName, int index);
+//pre: none
+//post: writes trace to traceName<index>.json and traceName<index>.folded
+#endif
+
+int resumeFile(SudokuMatrix* m, const char* checkpoint);
+//pre: m has been initialized
+//post: finishes the search saved in checkpoint and prints its solution or solution count and how long the rest of
+//	the search took. returns 1 if the checkpoint could not be used, 0 otherwise
+
+double elapsedMs(std::chrono::steady_clock::time_point start);
+//returns the wall clock time since start in milliseconds
+
+int main(int argc, char* argv[])
 {
-  SudokuMatrix* m=new SudokuMatrix();
+  SudokuMatrix* m;
   string userInput;
   bool userContinues = true;
   std::stack<Node>* solution;
-  Node next;
 
+  int firstFile = 1;
+  bool backjumping = false;
+  bool counting = false;
+  bool batching = false;
+  bool lockstep = true;
+  BatchMode batchMode = BATCH_SOLVE;
+  const char* outFile = NULL;
+  const char* traceName = NULL;
+  const char* checkpointFile = NULL;
+  const char* resumeFrom = NULL;
+  int checkpointSeconds = CHECKPOINT_SECONDS;
+  int numThreads = std::thread::hardware_concurrency();
+  while (firstFile < argc && argv[firstFile][0] == '-')
+  {
+    if (string(argv[firstFile]) == "-b")
+      backjumping = true;
+    else if (string(argv[firstFile]) == "-c")
+      counting = true;
+    else if (string(argv[firstFile]) == "-s")
+    {
+      batching = true;
+      batchMode = BATCH_SOLVE;
+    }
+    else if (string(argv[firstFile]) == "-d")
+      lockstep = false;
+    else if (string(argv[firstFile]) == "-g")
+    {
+      batching = true;
+      batchMode = BATCH_GRADE;
+    }
+    else if (string(argv[firstFile]) == "-o" && firstFile+1 < argc)
+      outFile = argv[++firstFile];
+    else if (string(argv[firstFile]) == "-T" && firstFile+1 < argc)
+    {
+#ifdef SUDOKU_TRACE
+      traceName = argv[++firstFile];
+#else
+      cout << "Tracing is not compiled in, rebuild with make TRACE=1" << endl;
+      return 1;
+#endif
+    }
+    else if (string(argv[firstFile]) == "-t" && firstFile+1 < argc)
+      numThreads = atoi(argv[++firstFile]);
+    else if (string(argv[firstFile]) == "-k" && firstFile+1 < argc)
+      checkpointFile = argv[++firstFile];
+    else if (string(argv[firstFile]) == "-i" && firstFile+1 < argc)
+      checkpointSeconds = atoi(argv[++firstFile]);
+    else if (string(argv[firstFile]) == "-r" && firstFile+1 < argc)
+      resumeFrom = argv[++firstFile];
+    else
+    {
+      cout << "Unknown option " << argv[firstFile] << endl;
+      return 1;
+    }
+    firstFile++;
+  }
+
+  if (resumeFrom != NULL && firstFile < argc)
+  {
+    cout << "-r carries on with the search in its checkpoint, it can't be given puzzle files too" << endl;
+    return 1;
+  }
+
+  //batch runs build their own matrices, one per worker
+  if (batching && firstFile < argc)
+  {
+    int failures = batchFiles(batchMode, argc-firstFile, argv+firstFile, numThreads, backjumping, lockstep, outFile);
+    return (failures == 0) ? 0 : 1;
+  }
+
+  m=new SudokuMatrix();
   if (!(m->initialize()))
   {
     cout << "Could not initialize matrix" << endl;
@@ -29,50 +164,51 @@ int main()
     return 1;
   }
   cout << "Initialized matrix" << endl << endl;
+  m->setBackjumping(backjumping);
+  //counting and resumed searches never backjump, so only a fresh solve with -b can't be saved
+  if (checkpointFile != NULL && backjumping && !counting && resumeFrom == NULL)
+  {
+    cout << "Searches with backjumping can't be checkpointed, ignoring -k" << endl;
+    checkpointFile = NULL;
+  }
+  if (checkpointFile == NULL)
+    checkpointFile = resumeFrom;
+  if (checkpointFile != NULL)
+    m->setCheckpoint(checkpointFile, checkpointSeconds);
+
+  if (resumeFrom != NULL)
+  {
+    int failures = resumeFile(m, resumeFrom);
+    delete m;
+    return failures;
+  }
+
+  if (firstFile < argc)
+  {
+    int failures;
+    if (counting)
+      failures = countFiles(m, argc-firstFile, argv+firstFile, numThreads);
+    else
+      failures = solveFiles(m, argc-firstFile, argv+firstFile, traceName);
+    delete m;
+    return (failures == 0) ? 0 : 1;
+  }
 
   //send m a sudoku puzzle to solve
   //m will return solution, or partial solution if failed.
 
-  int puzzle[MATRIX_SIZE][MATRIX_SIZE]; //the sudoku puzzle that will be filled with solution
-
   while (userContinues)
   {
-    for (int i=0;i<MATRIX_SIZE;i++)
-    {
-      for (int j=0;j<MATRIX_SIZE;j++)
-      {
-	puzzle[i][j] = 0;
-      }
-    }
-
     //print solution to screen
 
     string puzzleToSolve;
     cout << "\nFilename of puzzle to solve: ";
     cin >> puzzleToSolve;
     solution = m->solve(puzzleToSolve.c_str());
-    if (solution != NULL)
-    {
-      while(!solution->empty())
-      {
-	next = solution->top();
-	puzzle[next.row][next.column] = next.value+1;
-	solution->pop();
-      }
-    }
-    else
+    if (solution == NULL)
       cout << "Solution could not be found" << endl;
 
-    cout << "Solution: " << endl;
-    for (int i=0;i<MATRIX_SIZE;i++)
-    {
-      for (int j=0;j<MATRIX_SIZE;j++)
-      {
-	cout << puzzle[i][j] << " ";
-      }
-
-      cout << endl;
-    }
+    printSolution(solution);
     delete solution;
     solution = NULL;
 
@@ -96,3 +232,158 @@ int main()
 
   return 0;
 }
+
+void printSolution(std::stack<Node>* solution)
+{
+  int puzzle[MATRIX_SIZE][MATRIX_SIZE]; //the sudoku puzzle that will be filled with solution
+  Node next;
+  for (int i=0;i<MATRIX_SIZE;i++)
+  {
+    for (int j=0;j<MATRIX_SIZE;j++)
+    {
+      puzzle[i][j] = 0;
+    }
+  }
+
+  if (solution != NULL)
+  {
+    while(!solution->empty())
+    {
+      next = solution->top();
+      puzzle[next.row][next.column] = next.value+1;
+      solution->pop();
+    }
+  }
+
+  cout << "Solution: " << endl;
+  for (int i=0;i<MATRIX_SIZE;i++)
+  {
+    for (int j=0;j<MATRIX_SIZE;j++)
+    {
+      cout << puzzle[i][j] << " ";
+    }
+
+    cout << endl;
+  }
+}
+
+int solveFiles(SudokuMatrix* m, int numFiles, char* files[], const char* traceName)
+{
+  std::stack<Node>* solution;
+  int failures = 0;
+  std::chrono::steady_clock::time_point start;
+  double totalMs = 0, ms;
+
+  for (int f=0;f<numFiles;f++)
+  {
+    cout << files[f] << ": ";
+    start = std::chrono::steady_clock::now();
+    solution = m->solve(files[f]);
+    ms = elapsedMs(start);
+    totalMs += ms;
+
+    //a full solution has one entry per cell
+    if (solution == NULL || (int)solution->size() != MATRIX_SIZE*MATRIX_SIZE)
+      failures++;
+    printSolution(solution);
+    cout << "Time: " << ms << " ms" << endl << endl;
+#ifdef SUDOKU_TRACE
+    if (traceName != NULL && solution != NULL)
+      writeTrace(m->getTrace(), traceName, f);
+#endif
+    delete solution;
+  }
+
+  cout << "Solved " << numFiles-failures << " of " << numFiles << " puzzles in " << totalMs << " ms" << endl;
+  return failures;
+}
+
+int countFiles(SudokuMatrix* m, int numFiles, char* files[], int numThreads)
+{
+  unsigned long long count;
+  int failures = 0;
+  std::chrono::steady_clock::time_point start;
+
+  for (int f=0;f<numFiles;f++)
+  {
+    start = std::chrono::steady_clock::now();
+    if (m->countSolutions(files[f], numThreads, count))
+      cout << files[f] << ": " << count << " solutions in " << elapsedMs(start) << " ms" << endl;
+    else
+      failures++;
+  }
+  return failures;
+}
+
+int batchFiles(BatchMode mode, int numFiles, char* files[], int numThreads, bool backjumping, bool lockstep,
+    const char* outFile)
+{
+  ofstream fout;
+  ostream* out = &cout;
+  int failures;
+
+  if (outFile != NULL)
+  {
+    fout.open(outFile);
+    if (fout.fail())
+    {
+      cout << "Error, could not open " << outFile << " for writing" << endl;
+      return numFiles;
+    }
+    out = &fout;
+  }
+
+  BatchPipeline pipeline(mode, numThreads);
+  pipeline.setBackjumping(backjumping);
+  pipeline.setLockstep(lockstep);
+  failures = pipeline.run(numFiles, files, *out);
+  pipeline.printStats(cerr);
+  return failures;
+}
+
+#ifdef SUDOKU_TRACE
+void writeTrace(SearchTrace* trace, const char* traceName, int index)
+{
+  ofstream fout;
+  string base = string(traceName) + to_string(index);
+
+  fout.open((base + ".json").c_str());
+  trace->writeChromeTrace(fout);
+  fout.close();
+  fout.clear();
+  fout.open((base + ".folded").c_str());
+  trace->writeFoldedStacks(fout);
+  fout.close();
+  if (fout.fail())
+    cout << "Error, could not write the trace to " << base << ".json/.folded" << endl;
+  else
+    cout << "Wrote " << trace->recorded() << " decisions to " << base << ".json and " << base << ".folded" << endl;
+}
+#endif
+
+int resumeFile(SudokuMatrix* m, const char* checkpoint)
+{
+  std::stack<Node>* solution;
+  bool counting;
+  unsigned long long count;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  cout << checkpoint << ": ";
+  solution = m->resume(checkpoint, counting, count);
+  if (solution == NULL)
+    return 1;
+  if (counting)
+    cout << checkpoint << ": " << count << " solutions, " << elapsedMs(start) << " ms after resuming" << endl;
+  else
+  {
+    printSolution(solution);
+    cout << "Time: " << elapsedMs(start) << " ms after resuming" << endl;
+  }
+  delete solution;
+  return 0;
+}
+
+double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-start).count();
+}
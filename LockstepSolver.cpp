@@ -0,0 +1,114 @@
+//  LockstepSolver.cpp
+//  Purpose: Implements the LockstepSolver class defined in LockstepSolver.h
+
+#include "LockstepSolver.h"
+
+
+LockstepSolver::LockstepSolver()
+{
+  DifficultyGrader::buildUnits(unitCells, NULL);
+}
+
+int LockstepSolver::solve(Puzzle* puzzles, int count, Puzzle* solutions, char* solved)
+{
+  bool changed = true;
+  bool full;
+  int numSolved = 0;
+  int value;
+
+  //unused lanes start with every candidate and stay that way, since propagation has nothing to remove
+  for (int c=0;c<MATRIX_SIZE*MATRIX_SIZE;c++)
+  {
+    for (int l=0;l<LOCKSTEP_LANES;l++)
+    {
+      value = (l < count) ? puzzles[l].cells[c/MATRIX_SIZE][c%MATRIX_SIZE] : 0;
+      lanes[c][l] = (value == 0) ? ALL_CANDIDATES : (CandidateMask)1 << (value-1);
+    }
+  }
+  for (int l=0;l<LOCKSTEP_LANES;l++)
+    invalid[l] = 0;
+
+  //every pass that changes anything removes at least one candidate, so this always ends
+  while (changed)
+  {
+    changed = false;
+    for (int u=0;u<NUM_UNITS;u++)
+      changed |= propagateUnit(u);
+  }
+
+  for (int l=0;l<count;l++)
+  {
+    full = (invalid[l] == 0);
+    for (int c=0;c<MATRIX_SIZE*MATRIX_SIZE && full;c++)
+      full = ((lanes[c][l] & (lanes[c][l]-1)) == 0);
+    solved[l] = full;
+    if (!full)
+      continue;
+    for (int c=0;c<MATRIX_SIZE*MATRIX_SIZE;c++)
+      solutions[l].cells[c/MATRIX_SIZE][c%MATRIX_SIZE] = __builtin_ctzll(lanes[c][l]) + 1;
+    numSolved++;
+  }
+  return numSolved;
+}
+
+bool LockstepSolver::propagateUnit(int unit)
+{
+  //the loops over lanes are written without branches on lane contents so they vectorize
+  CandidateMask once[LOCKSTEP_LANES], twice[LOCKSTEP_LANES]; //values with at least one, and more than one, cell
+  CandidateMask fixed[LOCKSTEP_LANES], fixedTwice[LOCKSTEP_LANES]; //values fixed in one, and in more than one, cell
+  CandidateMask changes[LOCKSTEP_LANES], bad[LOCKSTEP_LANES];
+  CandidateMask m, single, hidden;
+  CandidateMask* cell;
+  CandidateMask anyChange = 0;
+
+  for (int l=0;l<LOCKSTEP_LANES;l++)
+  {
+    once[l] = twice[l] = fixed[l] = fixedTwice[l] = changes[l] = bad[l] = 0;
+  }
+
+  for (int k=0;k<MATRIX_SIZE;k++)
+  {
+    cell = lanes[unitCells[unit][k]];
+    for (int l=0;l<LOCKSTEP_LANES;l++)
+    {
+      m = cell[l];
+      single = ((m & (m-1)) == 0) ? m : 0;
+      fixedTwice[l] |= fixed[l] & single;
+      fixed[l] |= single;
+      twice[l] |= once[l] & m;
+      once[l] |= m;
+    }
+  }
+
+  //a value fixed twice, or with nowhere to go, means the lane has no solution
+  for (int l=0;l<LOCKSTEP_LANES;l++)
+  {
+    bad[l] = fixedTwice[l] | (once[l] ^ ALL_CANDIDATES);
+    once[l] &= ~twice[l]; //values with exactly one cell
+  }
+
+  for (int k=0;k<MATRIX_SIZE;k++)
+  {
+    cell = lanes[unitCells[unit][k]];
+    for (int l=0;l<LOCKSTEP_LANES;l++)
+    {
+      m = cell[l];
+      single = ((m & (m-1)) == 0) ? m : 0;
+      //naked singles: cells that aren't fixed lose the values fixed elsewhere in the unit
+      m = (single != 0) ? m : (CandidateMask)(m & ~fixed[l]);
+      //hidden singles: a value that only fits here takes the cell. Two of them in one cell is a contradiction
+      hidden = m & once[l];
+      m = (hidden != 0) ? hidden : m;
+      bad[l] |= (CandidateMask)(hidden & (hidden-1)) | (CandidateMask)(m == 0);
+      changes[l] |= m ^ cell[l];
+      cell[l] = m;
+    }
+  }
+
+  for (int l=0;l<LOCKSTEP_LANES;l++)
+  {
+    invalid[l] |= bad[l];
+    anyChange |= changes[l];
+  }
+  return (anyChange != 0);
+}
@@ -0,0 +1,42 @@
+//LockstepSolver.h
+//  Purpose: See below
+
+// solves LOCKSTEP_LANES puzzles at once by constraint propagation alone, as a fast path for batches where
+// most puzzles are easy.
+//
+// Every cell keeps a candidate bitmask per puzzle, stored lane by lane (lanes[cell][lane]), so the same step
+// for every puzzle is one pass over a short contiguous array that the compiler turns into vector instructions.
+// Each pass over a unit does the same work in every lane, with no branches on lane contents:
+//
+//   naked singles	values fixed in a cell of the unit are removed from the other cells
+//   hidden singles	a value with only one possible cell in the unit is placed there
+//
+// Passes repeat until no lane changes. Lanes that end up with every cell fixed are solved. The rest either
+// needed branching or ran into a contradiction, and are left for the caller to hand to SudokuMatrix, so the
+// results of a batch are the same as solving every puzzle with Dancing Links
+
+#pragma once
+
+#include "SudokuMatrix.h"
+#include "DifficultyGrader.h"
+#include "Definitions.h"
+
+class LockstepSolver
+{
+  public:
+    LockstepSolver();
+
+    int solve(Puzzle* puzzles, int count, Puzzle* solutions, char* solved);
+    //pre: 0 < count <= LOCKSTEP_LANES
+    //post: propagates all count puzzles together. For each puzzle that propagation solves, fills in its
+    //	solution and sets solved to 1, otherwise sets solved to 0 and leaves the solution alone.
+    //	returns the number of puzzles solved
+
+  private:
+    CandidateMask lanes[MATRIX_SIZE*MATRIX_SIZE][LOCKSTEP_LANES]; //candidates of every cell in every lane
+    CandidateMask invalid[LOCKSTEP_LANES]; //nonzero once a lane has hit a contradiction
+    int unitCells[NUM_UNITS][MATRIX_SIZE]; //cells of every row, then every column, then every box
+
+    bool propagateUnit(int unit);
+    //post: applies naked and hidden singles to one unit in every lane, returns whether any lane changed
+};
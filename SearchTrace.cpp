@@ -0,0 +1,184 @@
+//  SearchTrace.cpp
+//  Purpose: Implements the SearchTrace class defined in SearchTrace.h
+
+#include "SearchTrace.h"
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <unordered_map>
+#include <map>
+#include <algorithm>
+
+
+SearchTrace::SearchTrace()
+{
+  events = new TraceEvent[TRACE_BUFFER_SIZE];
+  //every decision fills one cell, so at most one decision per cell can be open at once
+  open = new TraceEvent[MATRIX_SIZE*MATRIX_SIZE];
+  childNs = new long long[MATRIX_SIZE*MATRIX_SIZE];
+  clear();
+}
+SearchTrace::~SearchTrace()
+{
+  delete [] events;
+  delete [] open;
+  delete [] childNs;
+}
+
+void SearchTrace::clear()
+{
+  numEvents = 0;
+  nextId = 0;
+  startTime = std::chrono::steady_clock::now();
+}
+
+long long SearchTrace::now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-startTime).count();
+}
+
+void SearchTrace::begin(int depth, int column, int columnSize, int row)
+{
+  TraceEvent& e = open[depth];
+  e.id = nextId++;
+  e.parent = (depth > 0) ? open[depth-1].id : -1;
+  e.column = column;
+  e.columnSize = columnSize;
+  e.row = row;
+  e.depth = depth;
+  childNs[depth] = 0;
+  e.startNs = now();
+}
+
+void SearchTrace::end(int depth)
+{
+  TraceEvent& e = open[depth];
+  e.durationNs = now() - e.startNs;
+  e.selfNs = e.durationNs - childNs[depth];
+  if (depth > 0)
+    childNs[depth-1] += e.durationNs;
+  events[numEvents % TRACE_BUFFER_SIZE] = e;
+  numEvents++;
+}
+
+long long SearchTrace::recorded()
+{
+  return numEvents;
+}
+
+long long SearchTrace::oldest()
+{
+  return (numEvents > TRACE_BUFFER_SIZE) ? numEvents - TRACE_BUFFER_SIZE : 0;
+}
+
+void SearchTrace::writeChromeTrace(std::ostream& out)
+{
+  TraceEvent* e;
+  std::ios::fmtflags flags = out.flags();
+  std::streamsize precision = out.precision();
+  out << "{\"traceEvents\":[" << std::endl;
+  //Chrome wants timestamps in microseconds. They're written in fixed point down to the ns, since the default
+  //format switches to 6 significant digits after a second, and nested decisions would share timestamps
+  out << std::fixed << std::setprecision(3);
+  for (long long n=oldest();n<numEvents;n++)
+  {
+    e = &events[n % TRACE_BUFFER_SIZE];
+    out << "{\"name\":\"" << columnName(e->column) << ":" << rowName(e->row) << "\",\"cat\":\"search\",\"ph\":\"X\""
+      << ",\"ts\":" << e->startNs/1000.0 << ",\"dur\":" << e->durationNs/1000.0 << ",\"pid\":1,\"tid\":1"
+      << ",\"args\":{\"id\":" << e->id << ",\"depth\":" << e->depth << ",\"column\":" << e->column
+      << ",\"columnSize\":" << e->columnSize << ",\"row\":" << e->row << ",\"selfNs\":" << e->selfNs << "}}"
+      << ((n+1 < numEvents) ? "," : "") << std::endl;
+  }
+  out << "],\"otherData\":{\"recorded\":" << numEvents << ",\"dropped\":" << oldest() << "}}" << std::endl;
+  out.flags(flags);
+  out.precision(precision);
+}
+
+void SearchTrace::writeFoldedStacks(std::ostream& out)
+{
+  std::vector<TraceEvent*> byAge; //buffered events, parents before children
+  std::unordered_map<long long, int> stackOf; //event id to the stack it ran in
+  std::map<std::pair<int, std::string>, int> children; //stack and frame to the stack one frame deeper
+  std::map<std::pair<int, std::string>, int>::iterator child;
+  //stacks form a tree with stack 0, the top of the search, at its root
+  std::vector<int> stackParent(1, 0);
+  std::vector<std::string> stackFrame(1, "");
+  std::vector<long long> stackNs(1, 0);
+  std::string frame, line;
+  TraceEvent* e;
+  int stack;
+
+  for (long long n=oldest();n<numEvents;n++)
+    byAge.push_back(&events[n % TRACE_BUFFER_SIZE]);
+  //a decision always begins after the one above it, so sorting by id puts parents first
+  std::sort(byAge.begin(), byAge.end(), [](TraceEvent* a, TraceEvent* b) { return a->id < b->id; });
+
+  for (unsigned int n=0;n<byAge.size();n++)
+  {
+    e = byAge[n];
+    //events are buffered as they end and a decision ends after every decision beneath it, so the
+    //parent of a buffered event is always buffered too
+    stack = (e->parent < 0) ? 0 : stackOf[e->parent];
+
+    //a run of forced decisions (columns with one row) is propagation rather than branching, so it's one frame
+    frame = (e->columnSize == 1) ? "forced" : frameName(e->column, e->columnSize);
+    if (!(frame == "forced" && stackFrame[stack] == "forced"))
+    {
+      child = children.find(std::make_pair(stack, frame));
+      if (child == children.end())
+      {
+	children[std::make_pair(stack, frame)] = stackParent.size();
+	stackParent.push_back(stack);
+	stackFrame.push_back(frame);
+	stackNs.push_back(0);
+	stack = stackParent.size()-1;
+      }
+      else
+	stack = child->second;
+    }
+    stackOf[e->id] = stack;
+    stackNs[stack] += e->selfNs;
+  }
+
+  for (unsigned int s=1;s<stackParent.size();s++)
+  {
+    line = stackFrame[s];
+    for (int p=stackParent[s];p!=0;p=stackParent[p])
+      line = stackFrame[p] + ";" + line;
+    out << line << " " << stackNs[s] << std::endl;
+  }
+}
+
+std::string SearchTrace::frameName(int column, int columnSize)
+{
+  std::ostringstream name;
+  static const char* kinds[4] = {"row", "col", "cell", "box"};
+  name << kinds[column/(MATRIX_SIZE*MATRIX_SIZE)] << "/" << columnSize;
+  return name.str();
+}
+
+std::string SearchTrace::columnName(int column)
+{
+  std::ostringstream name;
+  int section = column/(MATRIX_SIZE*MATRIX_SIZE);
+  int index = column%(MATRIX_SIZE*MATRIX_SIZE);
+  //rows, columns, and boxes need a value (index%MATRIX_SIZE) somewhere in unit index/MATRIX_SIZE,
+  //cells just need to be filled
+  if (section == ROW_OFFSET/(MATRIX_SIZE*MATRIX_SIZE))
+    name << "row" << index/MATRIX_SIZE+1 << "#" << index%MATRIX_SIZE+1;
+  else if (section == COL_OFFSET/(MATRIX_SIZE*MATRIX_SIZE))
+    name << "col" << index/MATRIX_SIZE+1 << "#" << index%MATRIX_SIZE+1;
+  else if (section == CELL_OFFSET/(MATRIX_SIZE*MATRIX_SIZE))
+    name << "cell" << index/MATRIX_SIZE+1 << "," << index%MATRIX_SIZE+1;
+  else
+    name << "box" << index/MATRIX_SIZE+1 << "#" << index%MATRIX_SIZE+1;
+  return name.str();
+}
+
+std::string SearchTrace::rowName(int row)
+{
+  std::ostringstream name;
+  //rows are numbered (i*COL_OFFSET+j*MATRIX_SIZE+k) for value k+1 in cell (i,j)
+  name << "r" << row/COL_OFFSET+1 << "c" << (row/MATRIX_SIZE)%MATRIX_SIZE+1 << "=" << row%MATRIX_SIZE+1;
+  return name.str();
+}
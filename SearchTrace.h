@@ -0,0 +1,101 @@
+//SearchTrace.h
+//  Purpose: See below
+
+// records the decisions Algorithm X makes so slow puzzles can be profiled.
+// Every decision (the column chosen, how many rows it had, the row tried, and the depth) becomes one event
+// once its subtree has been fully explored, and the event keeps how long the subtree took. Events go into a
+// ring buffer of TRACE_BUFFER_SIZE entries allocated up front, so recording never allocates and a long search
+// keeps only its most recent decisions.
+//
+// The trace can be written as a Chrome trace (load it in chrome://tracing or Perfetto) showing every decision,
+// or as folded stacks for flamegraph.pl and similar tools, which add up the time spent beneath each kind of
+// branch so it's easy to see which choices of chooseNextColumn the search time goes to.
+//
+// Recording is only compiled into SudokuMatrix when SUDOKU_TRACE is defined (make TRACE=1). Otherwise the
+// TRACE_ macros below expand to nothing and the solver pays nothing for it
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <chrono>
+#include "Definitions.h"
+
+#ifdef SUDOKU_TRACE
+#define TRACE_BEGIN(trace, depth, column, columnSize, row) (trace)->begin(depth, column, columnSize, row)
+#define TRACE_END(trace, depth) (trace)->end(depth)
+#else
+#define TRACE_BEGIN(trace, depth, column, columnSize, row) ((void)0)
+#define TRACE_END(trace, depth) ((void)0)
+#endif
+
+//one decision of the search, complete once its subtree has been explored
+struct TraceEvent
+{
+  long long id; //decisions are numbered in the order they were made
+  long long parent; //id of the decision this one was made beneath, -1 at the top of the tree
+  int column; //constraint index of the chosen column
+  int columnSize; //how many rows the column had to choose from
+  int row; //index of the row tried
+  int depth;
+  long long startNs; //since the trace was cleared
+  long long durationNs; //time spent in the subtree, including the decisions beneath it
+  long long selfNs; //time spent in the subtree minus the decisions directly beneath it
+};
+
+class SearchTrace
+{
+  public:
+    SearchTrace();
+    ~SearchTrace();
+
+    void clear();
+    //pre: none
+    //post: forgets every event and restarts the clock
+
+    void begin(int depth, int column, int columnSize, int row);
+    //pre: every decision above depth has begun and not ended
+    //post: starts timing a decision at depth
+
+    void end(int depth);
+    //pre: the decision at depth has begun and every decision beneath it has ended
+    //post: the decision's event is written to the ring buffer, overwriting the oldest one if it is full
+
+    long long recorded();
+    //returns how many events have been recorded since the trace was cleared, including overwritten ones
+
+    void writeChromeTrace(std::ostream& out);
+    //pre: none
+    //post: writes the events still in the buffer as a Chrome trace event file
+
+    void writeFoldedStacks(std::ostream& out);
+    //pre: none
+    //post: writes the events still in the buffer as "frame;frame;...;frame selfNs" lines. A frame is the kind
+    //	of constraint branched on and its number of rows, e.g. "cell/3", and runs of decisions that had only
+    //	one row are merged into a single "forced" frame. Each distinct stack is written once with the self
+    //	time of every decision that ran in it
+
+    static std::string columnName(int column);
+    //returns a readable name for a constraint, e.g. "row3#5" for "row 3 needs a 5" or "cell2,7" for
+    //"cell (2,7) needs a value"
+
+    static std::string rowName(int row);
+    //returns a readable name for a row, e.g. "r2c7=5"
+
+    static std::string frameName(int column, int columnSize);
+    //returns the folded stack frame for branching on column, e.g. "box/4"
+
+  private:
+    TraceEvent* events; //ring buffer
+    long long numEvents; //events recorded since the last clear, events[numEvents % TRACE_BUFFER_SIZE] is the next slot
+    long long nextId;
+    TraceEvent* open; //decisions that have begun and not ended, indexed by depth
+    long long* childNs; //time spent so far in the subtrees beneath each open decision
+    std::chrono::steady_clock::time_point startTime;
+
+    long long now();
+    //returns the time since the trace was cleared in ns
+
+    long long oldest();
+    //returns the number of the oldest event still in the buffer
+};
@@ -4,6 +4,8 @@
 //  Purpose: Implements the SudokuMatrix ADT defined in SudokuMatrix.h
 
 #include "SudokuMatrix.h"
+#include <thread>
+#include <cstdio>
 
 
 SudokuMatrix::SudokuMatrix()
@@ -11,40 +13,89 @@ SudokuMatrix::SudokuMatrix()
   Root = new Node();//points to upper left corner of matrix
   Root->header=true;
   Root->right=Root->left=Root->top=Root->bottom=Root; //Root points to itself in all directions
+  rowNodes = NULL;
+  colHeaders = NULL;
+  //every decision fills one cell, so the search can never go deeper than the number of cells
+  searchCols = new Node*[MATRIX_SIZE*MATRIX_SIZE];
+  searchRows = new Node*[MATRIX_SIZE*MATRIX_SIZE];
+  colNodes = NULL;
+  numCols = 0;
   workingSolution = new std::stack<Node>();
   Solved = false;
+  GivensConflict = false;
+  totalCompetition = 0;
+  numNodes = 0;
+  numBacktracks = 0;
+#ifdef SUDOKU_TRACE
+  trace = new SearchTrace();
+#endif
+
+  Backjumping = false;
+  Counting = false;
+  solutionCount = 0;
+  startDepth = 0;
+  checkpointSeconds = CHECKPOINT_SECONDS;
+  untilCheckpointCheck = CHECKPOINT_CHECK_INTERVAL;
+  currentDepth = -1;
+  removedAt = new int[MAX_ROWS];
+  chosenAt = new int[MAX_ROWS];
+  for (int i=0;i<MAX_ROWS;i++)
+  {
+    removedAt[i] = -1;
+    chosenAt[i] = -1;
+  }
+  conflictWords = (MATRIX_SIZE*MATRIX_SIZE+63)/64;
+  conflictSets = new unsigned long long[MATRIX_SIZE*MATRIX_SIZE*conflictWords];
+  conflict = new unsigned long long[conflictWords];
+  nogoods = new Nogood[NOGOOD_CACHE_SIZE];
+  for (int i=0;i<NOGOOD_CACHE_SIZE;i++)
+    nogoods[i].length = 0;
+  nextNogood = 0;
+  nogoodWatch = new std::vector<int>[MAX_ROWS];
 }
 SudokuMatrix::~SudokuMatrix()
 {
   deleteMatrix();
   delete Root;
+  delete [] searchCols;
+  delete [] searchRows;
   delete workingSolution;
+  delete [] removedAt;
+  delete [] chosenAt;
+  delete [] conflictSets;
+  delete [] conflict;
+  delete [] nogoods;
+  delete [] nogoodWatch;
+#ifdef SUDOKU_TRACE
+  delete trace;
+#endif
 }
 
-bool SudokuMatrix::AddColumn(Node* newNode)
+void SudokuMatrix::setBackjumping(bool enabled)
 {
-  if (!newNode->header)
-    return false;
-  else
-    return AddColumnHelp(newNode,Root);
+  Backjumping = enabled;
 }
 
-bool SudokuMatrix::AddColumnHelp(Node* newNode, Node* r)
+void SudokuMatrix::setCheckpoint(const char* filename, int seconds)
 {
-  if (r->right == Root && r != newNode) //disallow duplicate pointer insertion
-  {
-    //add column to the end of the column list
-    r->right->left = newNode;
-    newNode->right = r->right;
-    newNode->left = r;
-    r->right = newNode;
-    return true;
-  }
-  else if (r == newNode)
+  checkpointFile = (filename == NULL) ? "" : filename;
+  checkpointSeconds = seconds;
+}
+
+bool SudokuMatrix::AddColumn(Node* newNode)
+{
+  if (!newNode->header || newNode == Root)
+    return false;
+  //disallow duplicate pointer insertion
+  if (newNode->right != NULL && newNode->right != newNode && newNode->right->left == newNode)
     return false;
-  else
-    return AddColumnHelp(newNode,r->right);
 
+  //add column to the end of the column list
+  newNode->left = Root->left;
+  newNode->right = Root;
+  Root->left->right = newNode;
+  Root->left = newNode;
+  return true;
 }
 
 
@@ -76,23 +127,16 @@ void SudokuMatrix::print()
 
 void SudokuMatrix::deleteMatrix()
 {
-  Node* deleteNextCol = Root->right;
-  Node* deleteNextRow;
-  Node* temp;
-  while(deleteNextCol != Root)
-  {
-    deleteNextRow = deleteNextCol->bottom;
-    while(!deleteNextRow->header)
-    {
-      temp = deleteNextRow->bottom;
-      delete deleteNextRow;
-      deleteNextRow = temp;
-    }
-    temp = deleteNextCol->right;
-    delete deleteNextCol;
-    deleteNextCol = temp;
-  }
-
+  //row nodes and column headers each live in one contiguous block
+  Root->right=Root->left=Root;
+  numCols = 0;
+
+  delete [] colHeaders;
+  colHeaders = NULL;
+  delete [] colNodes;
+  colNodes = NULL;
+  delete [] rowNodes;
+  rowNodes = NULL;
 }
 
 std::stack<Node>* SudokuMatrix::solve(const char* filename)
@@ -114,10 +158,7 @@ std::stack<Node>* SudokuMatrix::solve(const char* filename)
      return successful, solution
 
    */
-  Solved = false;
-  totalCompetition = 0;
-  while(!workingSolution->empty())
-    workingSolution->pop();
+  int puzzle[MATRIX_SIZE][MATRIX_SIZE];
   std::ifstream fin;
   fin.open(filename);
   if (fin.fail())
@@ -127,56 +168,15 @@ std::stack<Node>* SudokuMatrix::solve(const char* filename)
     return NULL;
 
   }
-  int nextVal;
-
-  Node* toFind = NULL;
-  Node* insertNext = NULL;
-  std::stack<Node*> puzzleNodes;//list of nodes that were covered as part of reading in puzzle
-  Node* colNode,*nextRowInCol,*rowNode;
-  for (int i=0;i<MATRIX_SIZE;i++)//iterates through rows
+  if (!readPuzzle(fin, puzzle))
   {
-    for (int j=0;j<MATRIX_SIZE;j++) //iterates through columns
-    {
-      fin >> nextVal;
-      if (fin.fail() || nextVal > MATRIX_SIZE || nextVal < 0)
-      {
-	std::cout << "Invalid Sudoku Puzzle specified" << std::endl;
-	fin.close();
-	return NULL;
-      }
-
-      if (nextVal != 0)
-      {
-
-	toFind = new Node(i,j,nextVal-1);
-	insertNext = find(toFind);
-	if (insertNext == NULL)
-	{
-	  std::cout<<"Error in Sudoku Puzzle " << i << ", " << j << " val= " << nextVal << std::endl;
-	  fin.close();
-	  return NULL;
-	}
-	colNode = insertNext->colHeader;
-	//print();
-	nextRowInCol = insertNext;
-	cover(colNode);
-
-	rowNode = nextRowInCol->right;
-	while(rowNode != nextRowInCol)
-	{
-	  cover(rowNode->colHeader);
-	  rowNode = rowNode->right;
-	}
-
-
-	puzzleNodes.push(insertNext);
-	workingSolution->push(*insertNext);
-	delete toFind;
-      }
-    }
+    fin.close();
+    return NULL;
   }
   fin.close();
 
+  if (!loadPuzzle(puzzle))
+    return NULL;
 
   std::cout << "Solving..." << std::endl;
 
@@ -190,22 +190,13 @@ std::stack<Node>* SudokuMatrix::solve(const char* filename)
 
   //uncover the nodes that we covered earlier, so that we can solve a different puzzle
   //in the future
-  while(!puzzleNodes.empty())
-  {
-    colNode = (puzzleNodes.top())->colHeader;
-    nextRowInCol = (puzzleNodes.top());
-
+  unloadPuzzle();
 
-    rowNode = nextRowInCol->right;
-    while(rowNode != nextRowInCol)
-    {
-      uncover(rowNode->colHeader);
-      rowNode = rowNode->right;
-    }
-    uncover(colNode);
-    puzzleNodes.pop();
-  }
+  return copySolution();
+}
 
+std::stack<Node>* SudokuMatrix::copySolution()
+{
   std::stack<Node> temp,*toRet;
   while(!workingSolution->empty())
   {
@@ -218,39 +209,464 @@ std::stack<Node>* SudokuMatrix::solve(const char* filename)
     toRet->push(temp.top());
     temp.pop();
   }
+  return toRet;
+}
 
+std::stack<Node>* SudokuMatrix::resume(const char* filename, bool& counting, unsigned long long& count)
+{
+  int puzzle[MATRIX_SIZE][MATRIX_SIZE];
+  char magic[4];
+  int header[3]; //version, board size, counting
+  long long counters[4]; //solutions, rows tried, rows given up on, branching
+  int numGivens, row, depth;
+  bool valid;
+  bool wasBackjumping = Backjumping;
+  std::ifstream fin;
+  fin.open(filename, std::ios::binary);
+  if (fin.fail())
+  {
+    std::cout << "Error, could not open " << filename << " for reading" << std::endl;
+    return NULL;
+  }
 
+  fin.read(magic, 4);
+  fin.read((char*)header, sizeof(header));
+  fin.read((char*)counters, sizeof(counters));
+  fin.read((char*)&numGivens, sizeof(numGivens));
+  valid = !fin.fail() && std::string(magic, 4) == "SDKC" && header[0] == CHECKPOINT_VERSION &&
+    header[1] == MATRIX_SIZE && numGivens >= 0 && numGivens <= MATRIX_SIZE*MATRIX_SIZE;
 
-  return toRet;
+  for (int i=0;i<MATRIX_SIZE;i++)
+  {
+    for (int j=0;j<MATRIX_SIZE;j++)
+      puzzle[i][j] = 0;
+  }
+  for (int g=0;g<numGivens && valid;g++)
+  {
+    fin.read((char*)&row, sizeof(row));
+    valid = !fin.fail() && row >= 0 && row < MAX_ROWS;
+    //rows are numbered (i*COL_OFFSET+j*MATRIX_SIZE+k) for value k+1 in cell (i,j)
+    if (valid)
+      puzzle[row/COL_OFFSET][(row/MATRIX_SIZE)%MATRIX_SIZE] = row%MATRIX_SIZE+1;
+  }
+  if (valid)
+  {
+    fin.read((char*)&depth, sizeof(depth));
+    valid = !fin.fail() && depth >= 0 && depth <= MATRIX_SIZE*MATRIX_SIZE;
+  }
+  if (!valid)
+  {
+    std::cout << "Error, " << filename << " is not a checkpoint for " << MATRIX_SIZE << "x" << MATRIX_SIZE
+      << " puzzles" << std::endl;
+    return NULL;
+  }
+
+  if (!loadPuzzle(puzzle))
+    return NULL;
+  if (!replayCheckpoint(fin, depth))
+  {
+    std::cout << "Error, the search in " << filename << " doesn't match its puzzle" << std::endl;
+    unloadPuzzle();
+    return NULL;
+  }
+  fin.close();
+
+  //replaying counted the saved decisions as new rows tried, so restore the counters afterwards
+  solutionCount = counters[0];
+  numNodes = counters[1];
+  numBacktracks = counters[2];
+  totalCompetition = counters[3];
+  counting = (header[2] != 0);
+
+  std::cout << "Resuming at depth " << depth << "..." << std::endl;
+  //checkpoints only come from the chronological search
+  Counting = counting;
+  Backjumping = false;
+  startDepth = depth;
+  if (solve() && !counting)
+    std::cout << "Puzzle solved successfully!" << std::endl;
+  else if (!counting)
+    std::cout << "Puzzle not solveable!" << std::endl;
+  Counting = false;
+  Backjumping = wasBackjumping;
+  count = solutionCount;
+
+  unloadPuzzle();
+  return copySolution();
+}
+
+bool SudokuMatrix::replayCheckpoint(std::istream& in, int depth)
+{
+  int column, row;
+  Node *col, *r;
+  bool valid;
+
+  for (int d=0;d<depth;d++)
+  {
+    in.read((char*)&column, sizeof(column));
+    in.read((char*)&row, sizeof(row));
+    valid = !in.fail() && column >= 0 && column < MAX_COLS && row >= 0 && row < MAX_ROWS;
+    r = NULL;
+    if (valid)
+    {
+      //the chosen row has to still be in the chosen column
+      col = &colHeaders[column];
+      for (int k=0;k<ROW_WIDTH;k++)
+      {
+	if (rowNodes[row*ROW_WIDTH+k].colHeader == col)
+	  r = &rowNodes[row*ROW_WIDTH+k];
+      }
+      valid = (r != NULL && !isCovered(col) && r->top->bottom == r);
+    }
+    if (!valid)
+    {
+      while (d > 0)
+      {
+	d--;
+	untryRow(d);
+	uncover(searchCols[d]);
+      }
+      return false;
+    }
+
+    currentDepth = d;
+    cover(col);
+    searchCols[d] = col;
+    tryRow(d, r);
+  }
+  return true;
+}
+
+void SudokuMatrix::writeCheckpoint(int depth)
+{
+  std::string temp = checkpointFile + ".tmp";
+  std::ofstream fout;
+  int header[3] = {CHECKPOINT_VERSION, MATRIX_SIZE, Counting};
+  long long counters[4] = {(long long)solutionCount, numNodes, numBacktracks, totalCompetition};
+  int value;
+
+  fout.open(temp.c_str(), std::ios::binary);
+  fout.write("SDKC", 4);
+  fout.write((char*)header, sizeof(header));
+  fout.write((char*)counters, sizeof(counters));
+  value = givenRows.size();
+  fout.write((char*)&value, sizeof(value));
+  for (unsigned int g=0;g<givenRows.size();g++)
+  {
+    value = rowIndex(givenRows[g]);
+    fout.write((char*)&value, sizeof(value));
+  }
+  fout.write((char*)&depth, sizeof(depth));
+  for (int d=0;d<depth;d++)
+  {
+    fout.write((char*)&searchCols[d]->column, sizeof(int));
+    value = rowIndex(searchRows[d]);
+    fout.write((char*)&value, sizeof(value));
+  }
+  fout.close();
+
+  //only replace the previous checkpoint once the new one is safely written
+  if (fout.fail())
+  {
+    std::cout << "Error, could not write checkpoint " << temp << std::endl;
+    std::remove(temp.c_str());
+  }
+  else if (std::rename(temp.c_str(), checkpointFile.c_str()) != 0)
+    std::cout << "Error, could not replace checkpoint " << checkpointFile << std::endl;
+}
+
+void SudokuMatrix::countSubtrees(int puzzle[MATRIX_SIZE][MATRIX_SIZE], std::vector<std::vector<int> >* tasks,
+    std::atomic<unsigned int>* nextTask, std::atomic<unsigned long long>* total)
+{
+  unsigned long long subtotal = 0;
+  unsigned int t;
+  if (!initialize() || !loadPuzzle(puzzle))
+    return;
+
+  Counting = true;
+  while ((t = (*nextTask)++) < tasks->size())
+  {
+    //the rows leading to the subtree are treated as extra givens
+    std::vector<int>& prefix = (*tasks)[t];
+    for (unsigned int k=0;k<prefix.size();k++)
+      addGiven(&rowNodes[prefix[k]*ROW_WIDTH]);
+    solutionCount = 0;
+    solve();
+    subtotal += solutionCount;
+    removeGivens(prefix.size());
+  }
+  Counting = false;
+  unloadPuzzle();
+
+  *total += subtotal;
+}
+
+bool SudokuMatrix::solvePuzzle(int puzzle[MATRIX_SIZE][MATRIX_SIZE], int solution[MATRIX_SIZE][MATRIX_SIZE])
+{
+  Node next;
+  //cleared first so puzzles with conflicting givens still get an empty board
+  for (int i=0;i<MATRIX_SIZE;i++)
+  {
+    for (int j=0;j<MATRIX_SIZE;j++)
+      solution[i][j] = 0;
+  }
+  if (!loadPuzzle(puzzle, true))
+    return false;
+  solve();
+  unloadPuzzle();
+
+  while(!workingSolution->empty())
+  {
+    next = workingSolution->top();
+    solution[next.row][next.column] = next.value+1;
+    workingSolution->pop();
+  }
+  return Solved;
+}
+
+SearchStats SudokuMatrix::getStats()
+{
+  SearchStats stats;
+  stats.nodes = numNodes;
+  stats.backtracks = numBacktracks;
+  stats.branchingSum = totalCompetition;
+  return stats;
+}
+
+#ifdef SUDOKU_TRACE
+SearchTrace* SudokuMatrix::getTrace()
+{
+  return trace;
+}
+#endif
+
+bool SudokuMatrix::givensConflicted()
+{
+  return GivensConflict;
+}
+
+bool SudokuMatrix::readPuzzle(std::istream& in, int puzzle[MATRIX_SIZE][MATRIX_SIZE], bool quiet)
+{
+  int nextVal;
+  for (int i=0;i<MATRIX_SIZE;i++)//iterates through rows
+  {
+    for (int j=0;j<MATRIX_SIZE;j++) //iterates through columns
+    {
+      in >> nextVal;
+      if (in.fail() || nextVal > MATRIX_SIZE || nextVal < 0)
+      {
+	if (!quiet)
+	  std::cout << "Invalid Sudoku Puzzle specified" << std::endl;
+	return false;
+      }
+      puzzle[i][j] = nextVal;
+    }
+  }
+  return true;
+}
+
+bool SudokuMatrix::loadPuzzle(int puzzle[MATRIX_SIZE][MATRIX_SIZE], bool quiet)
+{
+  Solved = false;
+  GivensConflict = false;
+  totalCompetition = 0;
+  numNodes = 0;
+  numBacktracks = 0;
+  solutionCount = 0;
+  currentDepth = -1; //rows removed by the givens can't be blamed on any decision
+#ifdef SUDOKU_TRACE
+  trace->clear();
+#endif
+  while(!workingSolution->empty())
+    workingSolution->pop();
+
+  Node toFind;
+  Node* insertNext = NULL;
+  for (int i=0;i<MATRIX_SIZE;i++)//iterates through rows
+  {
+    for (int j=0;j<MATRIX_SIZE;j++) //iterates through columns
+    {
+      if (puzzle[i][j] != 0)
+      {
+	toFind = Node(i,j,puzzle[i][j]-1);
+	insertNext = find(&toFind);
+	if (insertNext == NULL)
+	{
+	  if (!quiet)
+	    std::cout<<"Error in Sudoku Puzzle " << i << ", " << j << " val= " << puzzle[i][j] << std::endl;
+	  GivensConflict = true;
+	  unloadPuzzle();
+	  return false;
+	}
+	addGiven(insertNext);
+	workingSolution->push(*insertNext);
+      }
+    }
+  }
+  return true;
+}
+
+void SudokuMatrix::addGiven(Node* r)
+{
+  cover(r->colHeader);
+  coverRow(r);
+  givenRows.push_back(r);
+}
+
+void SudokuMatrix::removeGivens(unsigned int n)
+{
+  //givens are uncovered in the reverse order they were covered
+  for (unsigned int i=0;i<n && !givenRows.empty();i++)
+  {
+    uncoverRow(givenRows.back());
+    uncover(givenRows.back()->colHeader);
+    givenRows.pop_back();
+  }
+}
+
+void SudokuMatrix::unloadPuzzle()
+{
+  removeGivens(givenRows.size());
+}
+
+bool SudokuMatrix::countSolutions(const char* filename, int numThreads, unsigned long long& count)
+{
+  int puzzle[MATRIX_SIZE][MATRIX_SIZE];
+  std::ifstream fin;
+  fin.open(filename);
+  if (fin.fail())
+  {
+    std::cout << "Error, could not open " << filename << " for reading" << std::endl;
+    fin.close();
+    return false;
+  }
+  if (!readPuzzle(fin, puzzle))
+  {
+    fin.close();
+    return false;
+  }
+  fin.close();
+
+  if (!loadPuzzle(puzzle))
+    return false;
+
+  count = 0;
+  Counting = true;
+  //a checkpoint can only describe one search
+  if (numThreads <= 1 || !checkpointFile.empty())
+  {
+    solve();
+    count = solutionCount;
+  }
+  else
+  {
+    //split the search tree into at least COUNT_TASKS_PER_THREAD subtrees per thread by expanding
+    //it breadth first. Each subtree is identified by the rows chosen on the way down to it
+    std::vector<std::vector<int> > frontier(1), next;
+    Node* nextCol;
+    int numRows;
+    while (!frontier.empty() && (int)frontier.size() < numThreads*COUNT_TASKS_PER_THREAD)
+    {
+      next.clear();
+      for (unsigned int t=0;t<frontier.size();t++)
+      {
+	for (unsigned int k=0;k<frontier[t].size();k++)
+	  addGiven(&rowNodes[frontier[t][k]*ROW_WIDTH]);
+
+	if (isEmpty())
+	  count++; //this subtree is already a full solution
+	else
+	{
+	  nextCol = chooseNextColumn(numRows);
+	  for (Node* r=nextCol->bottom;r!=nextCol;r=r->bottom)
+	  {
+	    next.push_back(frontier[t]);
+	    next.back().push_back(rowIndex(r));
+	  }
+	}
+
+	removeGivens(frontier[t].size());
+      }
+      frontier.swap(next);
+    }
+
+    //every worker needs a matrix of its own, since covering rows modifies it
+    std::atomic<unsigned int> nextTask(0);
+    std::atomic<unsigned long long> total(0);
+    std::vector<SudokuMatrix*> matrices;
+    std::vector<std::thread> workers;
+    for (int i=0;i<numThreads;i++)
+    {
+      matrices.push_back(new SudokuMatrix());
+      workers.push_back(std::thread(&SudokuMatrix::countSubtrees, matrices[i], puzzle, &frontier, &nextTask,
+	    &total));
+    }
+    for (int i=0;i<numThreads;i++)
+    {
+      workers[i].join();
+      delete matrices[i];
+    }
+    count += total;
+  }
+  Counting = false;
+
+  unloadPuzzle();
+  return true;
 }
 
 void SudokuMatrix::cover(Node* r)
 {
-  Node *RowNode, *RightNode,*ColNode=r->colHeader;
+  Node *RowNode, *RowStart, *RightNode,*ColNode=r->colHeader;
   ColNode->right->left = ColNode->left;
   ColNode->left->right = ColNode->right;
+  numCols--;
   for(RowNode = ColNode->bottom; RowNode!=ColNode; RowNode = RowNode->bottom)
   {
-    for(RightNode = RowNode->right; RightNode!=RowNode; RightNode = RightNode->right) 
+    //visit the rest of the row in the same order as walking right, but with a fixed trip count
+    //so the compiler can fully unroll the loop instead of chasing right pointers
+    RowStart = RowNode - RowNode->rowPos;
+    removedAt[(RowStart-rowNodes)/ROW_WIDTH] = currentDepth;
+    for(int k=1;k<ROW_WIDTH;k++)
     {
+      RightNode = RowStart + (RowNode->rowPos+k)%ROW_WIDTH;
       RightNode->top->bottom = RightNode->bottom;
       RightNode->bottom->top = RightNode->top;
+      RightNode->colHeader->size--;
     }
   }
 }
 
 void SudokuMatrix::uncover(Node* r)
 {
-  Node *RowNode, *LeftNode,*ColNode=r->colHeader;
+  Node *RowNode, *RowStart, *LeftNode,*ColNode=r->colHeader;
   for(RowNode = ColNode->top; RowNode!=ColNode; RowNode = RowNode->top) 
   {
-    for(LeftNode = RowNode->left; LeftNode!=RowNode; LeftNode = LeftNode->left) {
+    RowStart = RowNode - RowNode->rowPos;
+    for(int k=1;k<ROW_WIDTH;k++)
+    {
+      LeftNode = RowStart + (RowNode->rowPos+ROW_WIDTH-k)%ROW_WIDTH;
       LeftNode->top->bottom = LeftNode;
       LeftNode->bottom->top = LeftNode;
+      LeftNode->colHeader->size++;
     }
   }
   ColNode->right->left = ColNode;
   ColNode->left->right = ColNode;
+  numCols++;
+}
+
+void SudokuMatrix::coverRow(Node* r)
+{
+  Node* RowStart = r - r->rowPos;
+  for(int k=1;k<ROW_WIDTH;k++)
+    cover(RowStart[(r->rowPos+k)%ROW_WIDTH].colHeader);
+}
+
+void SudokuMatrix::uncoverRow(Node* r)
+{
+  Node* RowStart = r - r->rowPos;
+  for(int k=ROW_WIDTH-1;k>=1;k--)
+    uncover(RowStart[(r->rowPos+k)%ROW_WIDTH].colHeader);
 }
 
 bool SudokuMatrix::isEmpty()
@@ -258,86 +674,354 @@ bool SudokuMatrix::isEmpty()
   return (Root->right == Root);
 }
 
+bool SudokuMatrix::isCovered(Node* col)
+{
+  //cover() unlinks col from its neighbors but leaves col's own pointers alone, so col is
+  //only still in the list if its left neighbor points back at it
+  return (col->left->right != col);
+}
+
+int SudokuMatrix::rowIndex(Node* r)
+{
+  return (r - r->rowPos - rowNodes)/ROW_WIDTH;
+}
+
+void SudokuMatrix::tryRow(int depth, Node* r)
+{
+  searchRows[depth] = r;
+  chosenAt[rowIndex(r)] = depth;
+  numNodes++;
+  currentDepth = depth;
+  TRACE_BEGIN(trace, depth, searchCols[depth]->column, searchCols[depth]->size, rowIndex(r));
+  coverRow(r);
+}
+
+void SudokuMatrix::saveSolution(int depth)
+{
+  //decisions are pushed on top of the givens in the order they were made
+  for (int d=0;d<depth;d++)
+    workingSolution->push(*searchRows[d]);
+}
+
+void SudokuMatrix::untryRow(int depth)
+{
+  uncoverRow(searchRows[depth]);
+  chosenAt[rowIndex(searchRows[depth])] = -1;
+  TRACE_END(trace, depth);
+}
+
 bool SudokuMatrix::solve()
 {
-  if (isEmpty())
-    return true; //matrix is empty, solutions is filled
+  if (Backjumping && !Counting)
+    return solveBackjumping();
+
+  //Algorithm X, run iteratively so that the depth of the search is bounded by the
+  //size of the board rather than by the call stack
+  int depth = startDepth;
+  int numRows;
+  Node* nextCol;
+  Node* nextRowInCol;
+  Solved = false;
+  startDepth = 0;
+  lastCheckpoint = std::chrono::steady_clock::now();
+  untilCheckpointCheck = CHECKPOINT_CHECK_INTERVAL;
 
-  int numCols;
-  Node* nextCol = NULL;
-  nextCol = chooseNextColumn(numCols);
+  while (true)
+  {
+    //the search is between decisions here, so everything needed to carry on from this point is
+    //in searchCols and searchRows
+    if (!checkpointFile.empty() && --untilCheckpointCheck == 0)
+    {
+      untilCheckpointCheck = CHECKPOINT_CHECK_INTERVAL;
+      if (std::chrono::steady_clock::now()-lastCheckpoint >= std::chrono::seconds(checkpointSeconds))
+      {
+	writeCheckpoint(depth);
+	lastCheckpoint = std::chrono::steady_clock::now();
+      }
+    }
 
-  if (numCols < 1)
-    return false;
+    if (isEmpty())
+    {
+      //matrix is empty, solution is filled
+      if (!Counting)
+      {
+	Solved = true;
+	break;
+      }
+      solutionCount++; //when counting, just tally it and keep looking
+    }
+    else if (Counting && numCols == ROW_WIDTH)
+    {
+      //every row left covers exactly the remaining columns, so each of them completes a solution
+      solutionCount += Root->right->size;
+    }
+    else
+    {
+      nextCol = chooseNextColumn(numRows);
+      if (numRows > 0)
+      {
+	//descend into the first row of the chosen column
+	totalCompetition += numRows;
+	currentDepth = depth;
+	cover(nextCol);
+	searchCols[depth] = nextCol;
+	tryRow(depth, nextCol->bottom);
+	depth++;
+	continue;
+      }
+    }
 
-  totalCompetition += numCols;
+    //could not satisfy constraints of this column (or counted a solution), so back up to the
+    //most recent decision that still has rows left to try
+    nextRowInCol = NULL;
+    while (depth > 0 && nextRowInCol == NULL)
+    {
+      depth--;
+      untryRow(depth);
+      numBacktracks++;
+      nextRowInCol = searchRows[depth]->bottom;
+      if (nextRowInCol == searchCols[depth])
+      {
+	uncover(searchCols[depth]);
+	nextRowInCol = NULL;
+      }
+    }
+    if (nextRowInCol == NULL)
+      break; //every alternative has been exhausted
+
+    tryRow(depth, nextRowInCol);
+    depth++;
+  }
 
-  Node* nextRowInCol = nextCol->bottom;
-  Node* rowNode;
-  cover(nextCol);
+  if (Solved)
+    saveSolution(depth);
+  //the search is finished, so there is nothing left to resume
+  if (!checkpointFile.empty())
+    std::remove(checkpointFile.c_str());
 
-  //need check for solved so that matrix is successfully uncovered after solve, for memory management purposes
-  while(nextRowInCol != nextCol && !Solved) 
+  //need to uncover the decisions of a successful search as well, so the matrix can be reused.
+  //the solution itself stays in workingSolution
+  while (depth > 0)
   {
-    workingSolution->push(*nextRowInCol);
-    //cover(nextRowInCol);
-    rowNode = nextRowInCol->right;
-    while(rowNode != nextRowInCol)
+    depth--;
+    untryRow(depth);
+    uncover(searchCols[depth]);
+  }
+
+  return Solved;
+}
+
+bool SudokuMatrix::solveBackjumping()
+{
+  int depth = 0;
+  int numRows;
+  int jump;
+  Node* nextCol;
+  Node* nextRowInCol;
+  Solved = false;
+  clearNogoods();
+
+  while (true)
+  {
+    if (isEmpty())
+    {
+      Solved = true; //matrix is empty, solution is filled
+      break;
+    }
+
+    nextCol = chooseNextColumn(numRows);
+    if (numRows > 0)
     {
-      cover(rowNode->colHeader);
-      rowNode = rowNode->right;
+      //rows already missing from the column were taken out by earlier decisions,
+      //so those decisions share the blame for anything that fails beneath this one
+      totalCompetition += numRows;
+      columnReasons(nextCol, &conflictSets[depth*conflictWords], depth);
+      currentDepth = depth;
+      cover(nextCol);
+      searchCols[depth] = nextCol;
+      tryRow(depth, nextCol->bottom);
+      depth++;
+      if (!violatesNogood(searchRows[depth-1], conflict))
+	continue;
     }
+    else
+      columnReasons(nextCol, conflict, depth);
+
+    //conflict now holds the depths responsible for the failure. Jump back to the deepest of them,
+    //the decisions in between had nothing to do with it so their other rows are never tried
+    nextRowInCol = NULL;
+    while (nextRowInCol == NULL)
+    {
+      jump = -1;
+      for (int w=conflictWords-1;w>=0 && jump<0;w--)
+      {
+	if (conflict[w] != 0)
+	  jump = w*64 + 63 - __builtin_clzll(conflict[w]);
+      }
+      if (jump < 0)
+	break; //the failure doesn't depend on any decision, so there is no solution
+
+      while (depth-1 > jump)
+      {
+	depth--;
+	untryRow(depth);
+	numBacktracks++;
+	uncover(searchCols[depth]);
+      }
+      depth--;
+      untryRow(depth);
+      numBacktracks++;
+
+      conflict[jump/64] &= ~(1ULL << (jump%64));
+      for (int w=0;w<conflictWords;w++)
+	conflictSets[depth*conflictWords+w] |= conflict[w];
+
+      nextRowInCol = searchRows[depth]->bottom;
+      if (nextRowInCol != searchCols[depth])
+      {
+	tryRow(depth, nextRowInCol);
+	depth++;
+	if (violatesNogood(nextRowInCol, conflict))
+	  nextRowInCol = NULL;
+      }
+      else
+      {
+	//every row of this column failed, so its accumulated conflict set is the reason the
+	//decision above it failed too
+	uncover(searchCols[depth]);
+	for (int w=0;w<conflictWords;w++)
+	  conflict[w] = conflictSets[depth*conflictWords+w];
+	recordNogood(conflict, depth);
+	nextRowInCol = NULL;
+      }
+    }
+    if (nextRowInCol == NULL)
+      break; //every alternative has been exhausted
+  }
+
+  if (Solved)
+    saveSolution(depth);
+
+  while (depth > 0)
+  {
+    depth--;
+    untryRow(depth);
+    uncover(searchCols[depth]);
+  }
+
+  return Solved;
+}
 
+void SudokuMatrix::columnReasons(Node* col, unsigned long long* set, int depth)
+{
+  Node* next;
+  int removedBy;
+  for (int w=0;w<conflictWords;w++)
+    set[w] = 0;
 
-    Solved=solve();
-    if (!Solved)
+  for (int i=0;i<MATRIX_SIZE;i++)
+  {
+    next = colNodes[col->column*MATRIX_SIZE+i];
+    //a node that has been unlinked from its column no longer has its top neighbor pointing back at it
+    if (next->top->bottom != next)
     {
-      workingSolution->pop();
+      removedBy = removedAt[rowIndex(next)];
+      if (removedBy >= 0 && removedBy < depth)
+	set[removedBy/64] |= 1ULL << (removedBy%64);
     }
+  }
+}
 
+bool SudokuMatrix::violatesNogood(Node* r, unsigned long long* set)
+{
+  std::vector<int>& watching = nogoodWatch[rowIndex(r)];
+  Nogood* next;
+  int k;
+  for (unsigned int i=0;i<watching.size();i++)
+  {
+    next = &nogoods[watching[i]];
+    for (k=0;k<next->length && chosenAt[next->rows[k]] >= 0;k++)
+      ;
+    if (k == next->length)
+    {
+      for (int w=0;w<conflictWords;w++)
+	set[w] = 0;
+      for (k=0;k<next->length;k++)
+	set[chosenAt[next->rows[k]]/64] |= 1ULL << (chosenAt[next->rows[k]]%64);
+      return true;
+    }
+  }
+  return false;
+}
+
+void SudokuMatrix::recordNogood(unsigned long long* set, int depth)
+{
+  Nogood* slot = &nogoods[nextNogood];
+  int rows[NOGOOD_MAX_SIZE];
+  int length = 0;
 
-    rowNode = nextRowInCol->right;
-    while(rowNode != nextRowInCol)
+  for (int d=0;d<depth;d++)
+  {
+    if (set[d/64] & (1ULL << (d%64)))
     {
-      uncover(rowNode->colHeader);
-      rowNode = rowNode->right;
+      if (length == NOGOOD_MAX_SIZE)
+	return; //too specific to be worth remembering
+      rows[length++] = rowIndex(searchRows[d]);
     }
+  }
+  if (length == 0)
+    return;
 
-    nextRowInCol = nextRowInCol->bottom;
+  //evict whatever was in this slot before
+  for (int k=0;k<slot->length;k++)
+  {
+    std::vector<int>& watching = nogoodWatch[slot->rows[k]];
+    for (unsigned int i=0;i<watching.size();i++)
+    {
+      if (watching[i] == nextNogood)
+      {
+	watching[i] = watching.back();
+	watching.pop_back();
+	break;
+      }
+    }
   }
 
-  uncover(nextCol);
+  slot->length = length;
+  for (int k=0;k<length;k++)
+  {
+    slot->rows[k] = rows[k];
+    nogoodWatch[rows[k]].push_back(nextNogood);
+  }
+  nextNogood = (nextNogood+1)%NOGOOD_CACHE_SIZE;
+}
 
-  return Solved; //could not satisfy constraints of this column
+void SudokuMatrix::clearNogoods()
+{
+  for (int i=0;i<NOGOOD_CACHE_SIZE;i++)
+  {
+    for (int k=0;k<nogoods[i].length;k++)
+      nogoodWatch[nogoods[i].rows[k]].clear();
+    nogoods[i].length = 0;
+  }
+  nextNogood = 0;
 }
 
 Node* SudokuMatrix::chooseNextColumn(int& count)
 {
   Node* currentBest = Root->right;
   int best = -1;
-  int tempCount = 0;
 
-  //iterate through currentBest and count nodes, then iterate through currentBest's neighbors and count their nodes
-
-  Node* next = currentBest->bottom;
+  //every header keeps track of its own size, so this is a single pass over the column headers
   Node* nextCol = currentBest;
   while(nextCol != Root)
   {
-    next = nextCol->bottom;
-    tempCount = 0;
-    while(next != nextCol)
-    { 
-      if (next == next->bottom)
-      {
-	std::cout<<"Err!" << std::endl;
-      }
-      tempCount++;
-      next = next->bottom;
-    }
-    if (tempCount < best || best == -1)
+    if (nextCol->size < best || best == -1)
     {
       currentBest = nextCol;
-      best = tempCount;
+      best = nextCol->size;
+      if (best <= 1)
+	break; //can't do better than a dead end or a forced move
     }
     nextCol = nextCol->right;
   }
@@ -354,49 +1038,53 @@ Node* SudokuMatrix::chooseNextColumn(int& count)
 
 Node* SudokuMatrix::find(Node* find)
 {
-  Node* rightNode,*bottomNode;
-  rightNode = Root->right;
-  while(rightNode != Root) //iterate through column headers
+  if (rowNodes == NULL || find->row < 0 || find->row >= MATRIX_SIZE || find->column < 0 ||
+      find->column >= MATRIX_SIZE || find->value < 0 || find->value >= MATRIX_SIZE)
+    return NULL;
+
+  //rows are laid out in row, column, value order, so the row can be indexed directly.
+  //it is only still available if none of the columns it satisfies have been covered
+  Node* rowStart = &rowNodes[(find->row*COL_OFFSET+find->column*MATRIX_SIZE+find->value)*ROW_WIDTH];
+  for (int k=0;k<ROW_WIDTH;k++)
   {
-    bottomNode = rightNode->bottom;
-    while(bottomNode != rightNode) //iterate through columns
-    {
-      if (bottomNode->row == find->row && bottomNode->column == find->column && bottomNode->value == find->value)
-      {
-	return bottomNode;
-      }
-      bottomNode = bottomNode->bottom;
-    }
-    rightNode = rightNode->right;
+    if (isCovered(rowStart[k].colHeader))
+      return NULL;//not found
   }
 
-  return NULL;//not found
+  return rowStart;
 } //end find method
 
 bool SudokuMatrix::initialize()
 {
 
-  //Step 1: Construct maximum matrix (324x729)
-  //Step 2: Use maximum matrix to build dancing links structure (matrix A)
+  //Step 1: Construct the nonzero entries of the maximum matrix (324x729) row by row
+  //Step 2: Use those entries to build dancing links structure (matrix A)
   //Step 3: Read in initial sudoku grid of 1s and 0s
   //Step 4: Parse sudoku grid for {r,c,b,v}, and add those to the partial solution S* (removing from A)
   //r=row c=column b=box v=value (1,2,3,...,9)
   //Step 5: Perform Algorithm X on remaining A until exact cover is found --> S* is final solution
   //Step 6: Output final solution
 
-  Node* matrix[MAX_ROWS][MAX_COLS];
-  //initialize matrix
-  for (int i=0;i<MAX_ROWS;i++)
+  //the full matrix is *very* sparse, and for large boards far too big for the stack, so only the
+  //nonzero entries are ever stored: ROW_WIDTH nodes per row, plus one header per column, all on the heap
+  if (rowNodes != NULL)
+    deleteMatrix();
+  rowNodes = new Node[MAX_ROWS*ROW_WIDTH];
+  colHeaders = new Node[MAX_COLS];
+  colNodes = new Node*[MAX_COLS*MATRIX_SIZE];
+
+  for (int j=0;j<MAX_COLS;j++)
   {
-    for (int j=0;j<MAX_COLS;j++)
-    {
-      matrix[i][j] = NULL;
-    }
+    colHeaders[j].header=true;
+    colHeaders[j].column=j;
+    //link colHeader to self vertically, AddColumn links it into the header list below
+    colHeaders[j].top=colHeaders[j].bottom=colHeaders[j].colHeader=&colHeaders[j];
   }
 
-  //set appropriate non-null values in matrix
   int row=0;
-  Node *rowNode,*colNode,*cellNode,*boxNode;
+  int cols[ROW_WIDTH];
+  Node* nextNode;
+  Node* nextColHeader;
   for (int i=0;i<MATRIX_SIZE;i++) //rows
   {
     for (int j=0;j<MATRIX_SIZE;j++) //columns
@@ -406,92 +1094,51 @@ bool SudokuMatrix::initialize()
 	row = (i*COL_OFFSET+j*MATRIX_SIZE+k);
 
 	//each one of these 729 combinations of r,c,and v results in 4 constraints being satisfied in our grid
-	//i.e. 4 NULL values changed to Non-Null values
-	//this is a *very* sparse matrix, which is why it will be converted to a DLX (Dancing Links) representation
-	rowNode=matrix[row][ROW_OFFSET+(i*MATRIX_SIZE+k)] = new Node(i,j,k);
-	colNode=matrix[row][COL_OFFSET+(j*MATRIX_SIZE+k)] = new Node(i,j,k);
-	cellNode=matrix[row][CELL_OFFSET+(i*MATRIX_SIZE+j)] = new Node(i,j,k);
-	boxNode=matrix[row][BOX_OFFSET+((i/ROW_BOX_DIVISOR + j/COL_BOX_DIVISOR * COL_BOX_DIVISOR)*MATRIX_SIZE+k)] = new
-	  Node(i,j,k);
-
-	//link the nodes we just created to save time later
-	rowNode->right =colNode;
-	rowNode->left=boxNode;
-	colNode->left=rowNode;
-	colNode->right=cellNode;
-	cellNode->left=colNode;
-	cellNode->right=boxNode;
-	boxNode->left=cellNode;
-	boxNode->right=rowNode;
+	cols[0] = ROW_OFFSET+(i*MATRIX_SIZE+k);
+	cols[1] = COL_OFFSET+(j*MATRIX_SIZE+k);
+	cols[2] = CELL_OFFSET+(i*MATRIX_SIZE+j);
+	cols[3] = BOX_OFFSET+((i/ROW_BOX_DIVISOR + j/COL_BOX_DIVISOR * COL_BOX_DIVISOR)*MATRIX_SIZE+k);
 
+	for (int n=0;n<ROW_WIDTH;n++)
+	{
+	  nextNode = &rowNodes[row*ROW_WIDTH+n];
+	  *nextNode = Node(i,j,k);
+	  nextNode->rowPos = n;
+
+	  //link the nodes of the row to each other
+	  nextNode->left = &rowNodes[row*ROW_WIDTH+(n+ROW_WIDTH-1)%ROW_WIDTH];
+	  nextNode->right = &rowNodes[row*ROW_WIDTH+(n+1)%ROW_WIDTH];
+
+	  //rows are generated in increasing order, so add the node to the bottom of its column
+	  nextColHeader = &colHeaders[cols[n]];
+	  nextNode->colHeader = nextColHeader;
+	  nextNode->top = nextColHeader->top;
+	  nextNode->bottom = nextColHeader;
+	  nextColHeader->top->bottom = nextNode;
+	  nextColHeader->top = nextNode;
+	  colNodes[cols[n]*MATRIX_SIZE+nextColHeader->size] = nextNode;
+	  nextColHeader->size++;
+	}
       }
     }
   }
 
-  //write matrix to a text file
-  /*ofstream fout;
-    fout.open("CoverMatrix.txt");
-
-    for (int i=0;i<MAX_ROWS;i++)
-    {
-    for (int j=0;j<MAX_COLS;j++)
-    {
-    if (matrix[i][j] == NULL)
-    fout << "0";
-    else
-    fout << "1";
-
-    }
-    fout << endl;
-    }
-
-    fout.close();*/
-
   //Link columns together for dancing links
-  Node* nextColHeader;
-  Node* nextColRow;
   for (int j=0;j<MAX_COLS;j++)
   {
-    nextColHeader = new Node();
-    nextColHeader->header=true;
-    //link colHeader to self
-    nextColHeader->top=nextColHeader->bottom=nextColHeader->left=nextColHeader->right=nextColHeader->colHeader=nextColHeader;
-    nextColRow = nextColHeader;
-
-    for (int i=0;i<MAX_ROWS;i++)
-    {
-      if (matrix[i][j] != NULL)
-      {
-	//search down rows to add to column
-	matrix[i][j]->top=nextColRow;
-	nextColRow->bottom = matrix[i][j];
-	matrix[i][j]->bottom = nextColHeader;
-	nextColHeader->top = matrix[i][j];
-	matrix[i][j]->colHeader = nextColHeader;
-	nextColRow = matrix[i][j];
-      }
-    }
+    nextColHeader = &colHeaders[j];
     if (nextColHeader->bottom == nextColHeader)
     {
       std::cout<<"Err! column has no rows! col:" << j << std::endl;
     }
+    numCols++;
     if(!AddColumn(nextColHeader))
     {
       std::cout << "Error in adding column to matrix" << std::endl;
 
       //cleanup
-      for (int i=0;i<MAX_ROWS;i++)
-      {
-	for (int j=0;j<MAX_COLS;j++)
-	{
-	  if (matrix[i][j] != NULL)
-	    delete matrix[i][j];
-	}
-      }
+      deleteMatrix();
       return false;
-
-
-
     }
   }
 
@@ -67,10 +67,15 @@
 
 #include <iostream>
 #include <stack>
+#include <vector>
+#include <atomic>
 #include <fstream>
 #include <cmath>
 #include <stdlib.h>
+#include <string>
+#include <chrono>
 #include "Definitions.h"
+#include "SearchTrace.h"
 
 
 //Node structure to be used in DLX
@@ -82,13 +87,16 @@ struct Node
   Node* right;
   Node* colHeader;
   int row;
-  int column;
+  int column; //for headers, the index of the constraint column instead
   int value;
+  int rowPos; //index of this node within its row's contiguous block of ROW_WIDTH nodes, -1 for headers
+  int size; //headers only: number of rows currently in this column
   bool header;
   Node()
   {
     top=bottom=left=right=colHeader=NULL;
-    row=column=value=-1;
+    row=column=value=rowPos=-1;
+    size=0;
     header=false;
   }
   Node(int r,int c,int v)
@@ -97,10 +105,33 @@ struct Node
     row=r;
     column=c;
     value=v;
+    rowPos=-1;
+    size=0;
     header=false;
   }
 };
 
+//a whole board, 0 for empty cells, so that boards can be kept in containers
+struct Puzzle
+{
+  int cells[MATRIX_SIZE][MATRIX_SIZE];
+};
+
+//measurements of the last search, used to judge how hard a puzzle was
+struct SearchStats
+{
+  long long nodes; //number of rows tried
+  long long backtracks; //number of rows given up on because the search beneath them failed
+  long long branchingSum; //sum of the sizes of the columns branched on
+};
+
+//a learned nogood: a set of rows (by index into the matrix) that can't all be in the same solution
+struct Nogood
+{
+  int rows[NOGOOD_MAX_SIZE];
+  int length; //0 if this cache slot is unused
+};
+
 class SudokuMatrix
 {
   public:
@@ -116,6 +147,77 @@ class SudokuMatrix
     bool AddColumn(Node* newNode);
     //pre: newNode is a column header
     //post: newNode is added to the end of the column headers list in our matrix
+    //	returns false if newNode is not a header or is already in the list
+
+    bool countSolutions(const char* filename, int numThreads, unsigned long long& count);
+    //pre: the matrix has been initialized
+    //post: sets count to the number of ways the puzzle in the given file can be completed, without
+    //	keeping any of the solutions. With more than one thread, the top of the search tree is expanded
+    //	until there are plenty of subtrees to go around, and each thread counts subtrees with a matrix of
+    //	its own. Returns false if the puzzle couldn't be read.
+    //	Counting uses a single thread while checkpointing is on (see setCheckpoint)
+
+    bool solvePuzzle(int puzzle[MATRIX_SIZE][MATRIX_SIZE], int solution[MATRIX_SIZE][MATRIX_SIZE]);
+    //pre: the matrix has been initialized and no other puzzle is loaded
+    //post: solves puzzle without printing anything, filling solution with as much of the board as was
+    //	solved (0 elsewhere). Returns whether the puzzle was solved
+
+    bool givensConflicted();
+    //pre: none
+    //post: returns whether the most recent puzzle loaded was rejected because its givens conflict
+
+    SearchStats getStats();
+    //pre: none
+    //post: returns the measurements of the most recent search
+
+#ifdef SUDOKU_TRACE
+    SearchTrace* getTrace();
+    //pre: none
+    //post: returns the decisions recorded since the most recent puzzle was loaded
+#endif
+
+    static bool readPuzzle(std::istream& in, int puzzle[MATRIX_SIZE][MATRIX_SIZE], bool quiet = false);
+    //pre: none
+    //post: reads the next MATRIX_SIZE*MATRIX_SIZE cell values (0 for empty) from in, in the same format
+    //	as the files given to solve. Returns false if in ran out or held an invalid value, and says why
+    //	on stdout unless quiet
+
+    bool loadPuzzle(int puzzle[MATRIX_SIZE][MATRIX_SIZE], bool quiet = false);
+    //pre: the matrix has been initialized and no other puzzle is loaded
+    //post: covers the rows for the puzzle's givens and adds them to the working solution.
+    //	Returns false, leaving nothing loaded, if the givens conflict with each other, and says which
+    //	given conflicts on stdout unless quiet
+
+    void unloadPuzzle();
+    //pre: none
+    //post: uncovers the givens of the loaded puzzle so another one can be loaded
+
+    void setCheckpoint(const char* filename, int seconds);
+    //pre: none
+    //post: if filename isn't NULL, solve and countSolutions save the state of their search to filename every
+    //	seconds seconds, and remove it once the search finishes. Searches with backjumping aren't saved.
+    //	The file is replaced atomically, so a search killed in the middle of saving leaves the previous checkpoint
+
+    std::stack<Node>* resume(const char* filename, bool& counting, unsigned long long& count);
+    //pre: the matrix has been initialized and no puzzle is loaded
+    //post: rebuilds the search saved in the checkpoint file and carries on from where it stopped, saving new
+    //	checkpoints if setCheckpoint is on. Sets counting to whether the saved search was counting solutions and
+    //	count to the total number found, including the ones counted before the checkpoint. Returns the solution
+    //	like solve does (just the givens for counting), or NULL if the file isn't a usable checkpoint
+    /* A checkpoint (in the machine's byte order) holds:
+       "SDKC", CHECKPOINT_VERSION, MATRIX_SIZE, whether the search was counting		4 bytes, then 3 ints
+       solutions counted so far, rows tried, rows given up on, sum of branching		4 long longs
+       number of givens, then the row index of each given					ints
+       depth of the search, then the column and row chosen at each depth			ints
+       The rows of a column are always visited in the same order, so the row chosen at a depth also tells
+       which rows of its column have already been tried: every row above it.
+     */
+
+    void setBackjumping(bool enabled);
+    //pre: none
+    //post: if enabled, solve uses conflict-directed backjumping: when a column runs out of rows it jumps
+    //	straight back to the most recent decision that helped empty it, rather than retrying every
+    //	decision in between, and caches the nogoods it learns along the way. Off by default
 
     void print();
     //pre: none
@@ -146,12 +248,43 @@ class SudokuMatrix
 
   private:
     Node* Root;//points to first column header of matrix
+    Node* rowNodes; //every non-header node, stored row by row with ROW_WIDTH nodes per row
+    Node* colHeaders; //every column header, indexed by constraint column
+    Node** searchCols; //column chosen at each depth of the search
+    Node** searchRows; //row currently being tried at each depth of the search
+    Node** colNodes; //every node of every column, MATRIX_SIZE per column, whether covered or not
+    int numCols; //number of columns that haven't been covered
+    std::vector<Node*> givenRows; //rows covered for the loaded puzzle's givens, in the order they were covered
+    bool Counting; //if true, solve() counts every solution instead of stopping at the first
+    unsigned long long solutionCount; //solutions counted so far
+    int startDepth; //depth the next call to solve() starts at, nonzero after resume has rebuilt a search
+
+    //state for checkpointing
+    std::string checkpointFile; //empty if checkpointing is off
+    int checkpointSeconds; //time between checkpoints
+    long long untilCheckpointCheck; //iterations of solve() left before it next looks at the clock
+    std::chrono::steady_clock::time_point lastCheckpoint;
+
+    //state for conflict-directed backjumping
+    bool Backjumping; //if true, solve() uses solveBackjumping()
+    int currentDepth; //search depth that cover() attributes removed rows to, -1 for the puzzle's givens
+    int* removedAt; //for each row, the depth of the cover that last removed it from the matrix
+    int* chosenAt; //for each row, the depth it was chosen at, or -1 if it isn't in the partial solution
+    int conflictWords; //number of 64 bit words in one conflict set
+    unsigned long long* conflictSets; //for each depth, the set of shallower depths its failures depend on
+    unsigned long long* conflict; //conflict set of the failure currently being backed out of
+    Nogood* nogoods; //ring buffer of learned nogoods
+    int nextNogood; //slot the next learned nogood goes in
+    std::vector<int>* nogoodWatch; //for each row, the nogoods it appears in
     std::stack<Node>* workingSolution; //the partial or full solution to the current puzzle
     bool Solved; //if solution found, true, else false
-    int totalCompetition;
-
-    bool AddColumnHelp(Node* newNode, Node* r);
-    //helper function for AddColumn
+    bool GivensConflict; //if the most recent puzzle loaded had conflicting givens, true
+    long long totalCompetition; //sum of the sizes of the columns branched on
+    long long numNodes; //rows tried
+    long long numBacktracks; //rows given up on
+#ifdef SUDOKU_TRACE
+    SearchTrace* trace; //every decision of the current search
+#endif
 
     bool isEmpty(); 
     //returns whether Root is only node in the matrix
@@ -166,10 +299,55 @@ class SudokuMatrix
     void uncover(Node* r); 
     //unhides r from rest of matrix. r is assumed to be a column header
 
+    void coverRow(Node* r);
+    //covers the columns of every other node in r's row, r's own column is assumed to be covered already
+    //rows are fixed width and stored contiguously, so this walks the row block instead of the right pointers
+
+    void uncoverRow(Node* r);
+    //undoes coverRow(r), uncovering the columns in the reverse order they were covered
+
     Node* find(Node* find);
-    // searches for find, if found, returns first found node, else returns NULL
+    // looks up the row for find's row, column, and value. If that row is still available
+    // returns its first node, else returns NULL
+
+    bool isCovered(Node* col);
+    //returns whether the column header col has been removed from the header list
+
+    int rowIndex(Node* r);
+    //returns the index of r's row in the matrix
+
+    void tryRow(int depth, Node* r);
+    //records r as the choice at the given search depth, adds it to the partial solution and covers its row
+
+    void saveSolution(int depth);
+    //pushes the rows chosen at depths 0 through depth-1 onto workingSolution
+
+    void addGiven(Node* r);
+    //covers every column of r's row as if it were one of the puzzle's givens
 
-    bool solve(); //recursively called function that performs Algorithm X
+    void removeGivens(unsigned int n);
+    //uncovers the n most recently added givens
+
+    void countSubtrees(int puzzle[MATRIX_SIZE][MATRIX_SIZE], std::vector<std::vector<int> >* tasks,
+	std::atomic<unsigned int>* nextTask, std::atomic<unsigned long long>* total);
+    //worker thread for countSolutions. Initializes this matrix, loads the puzzle, then keeps taking the
+    //next subtree from tasks (the rows leading to it), counting its solutions, until none are left.
+    //Adds its count to total
+
+    void untryRow(int depth);
+    //undoes the coverRow done by tryRow at the given depth. The partial solution is left alone
+
+    void writeCheckpoint(int depth);
+    //saves the search, with decisions at depths 0 through depth-1, to checkpointFile
+
+    bool replayCheckpoint(std::istream& in, int depth);
+    //re-covers the columns and rows of depth decisions read from in. If one of them doesn't fit the
+    //matrix, everything replayed is undone and false is returned
+
+    std::stack<Node>* copySolution();
+    //returns a copy of workingSolution and empties it
+
+    bool solve(); //performs Algorithm X using an explicit stack of decisions (searchCols/searchRows)
     /* Algorithm X:
        if the matrix is empty, terminate successfully
        else choose a column c with the least 1s
@@ -184,10 +362,37 @@ class SudokuMatrix
 
      */
 
+    bool solveBackjumping();
+    //performs Algorithm X with conflict-directed backjumping and nogood caching
+    /* Every row removed from the matrix remembers the depth whose cover removed it. When a column
+       has no rows left, the depths that removed its rows form the conflict set of the failure, and
+       the search backs up directly to the deepest of them. Each depth accumulates the conflict sets
+       of the failures beneath it, and once all of its rows have failed, that set becomes the conflict
+       set one level up and is cached as a nogood so the same combination is rejected immediately if
+       another branch runs into it again
+     */
+
+    void columnReasons(Node* col, unsigned long long* set, int depth);
+    //sets set to the depths (shallower than depth) that removed the rows missing from col
+
+    bool violatesNogood(Node* r, unsigned long long* set);
+    //checks the cached nogoods containing r's row. If every row of one of them is in the partial
+    //solution, sets set to the depths those rows were chosen at and returns true
+
+    void recordNogood(unsigned long long* set, int depth);
+    //caches the rows chosen at the depths in set as a nogood, evicting the oldest one if the cache is full
+
+    void clearNogoods();
+    //empties the nogood cache
+
     Node* chooseNextColumn(int& count);
     //returns a pointer to a column in the matrix
     //that has the fewest nodes in its row
     //this is used as the heuristic for choosing the next constraint to satisfy
-    //in dancing links
+    //in dancing links. A column with 0 or 1 rows is returned immediately, since it is either
+    //a dead end or a forced move
+    //taking forced moves first is the solver's propagation: a cell column with one row left is a naked
+    //single, and a row, column, or box column with one row left is a hidden single, so the search applies
+    //every single (and finds every contradiction they lead to) before it ever branches
 
 };